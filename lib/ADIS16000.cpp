@@ -42,6 +42,7 @@ ADIS16000::ADIS16000(int CS, int RST) {
   pinMode(_RST, OUTPUT); // Set RST pin to be an output
   digitalWrite(_CS, HIGH); // Initialize CS pin to be high
   digitalWrite(_RST, HIGH); // Initialize RST pin to be high
+  _resetState = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -53,14 +54,21 @@ ADIS16000::~ADIS16000() {
 }
 
 ////////////////////////////////////////////////////////////////////////////
-// Performs a hardware reset by setting _RST pin low for delay (in ms).
+// Performs a hardware reset by setting _RST pin low, then polls PROD_ID_G
+// until the gateway answers, for at most RESET_TIMEOUT_US. Blocking
+// wrapper around beginReset and pollReset.
+////////////////////////////////////////////////////////////////////////////
+// ms - minimum settle delay in milliseconds after _RST is released
 ////////////////////////////////////////////////////////////////////////////
 int ADIS16000::resetDUT(uint8_t ms) {
-  digitalWrite(_RST, LOW);
-  delay(100);
-  digitalWrite(_RST, HIGH);
-  delay(ms);
-  return 1;
+  int ready;
+  beginReset();
+  while ((ready = pollReset(RESET_TIMEOUT_US)) == 0)
+    ;
+  uint32_t settle = RESET_PULSE_US + (uint32_t)ms * 1000;
+  while (micros() - _resetStart < settle)
+    ;
+  return ready > 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -143,31 +151,529 @@ int ADIS16000::regWrite(uint8_t regAddr,uint16_t regData) {
   return 1;
 }
 
-int addSensor(uint8_t sensorAddr) {
-	regWrite(GLOB_CMD_G, 0x01);
-	delayMicroseconds(500);
-	regWrite(CMD_DATA, sensorAddr);
-	return 1;
+////////////////////////////////////////////////////////////////////////////
+// Reads a list of registers with one SPI frame per register plus one.
+// Each frame sends the next address while the previous register's data
+// is clocked out, instead of an address frame and a data frame apiece.
+////////////////////////////////////////////////////////////////////////////
+// regAddrs - registers to read, on the current page
+// count - number of registers
+// values - receives the register values
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::regReadBurst(const uint8_t *regAddrs, uint8_t count, int16_t *values) {
+  for (uint8_t i = 0; i <= count; i++) {
+    uint8_t regAddr = i < count ? regAddrs[i] : 0x00;
+    digitalWrite(_CS, LOW);
+    uint8_t _msbData = SPI.transfer(regAddr);
+    uint8_t _lsbData = SPI.transfer(0x00);
+    digitalWrite(_CS, HIGH);
+    if (i > 0)
+      values[i - 1] = (int16_t)((_msbData << 8) | (_lsbData & 0xFF));
+    delayMicroseconds(15); // Delay to not violate read rate (40us)
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Brings registers of one page to the desired values. All registers are
+// read in one burst, and only the ones that differ are written.
+////////////////////////////////////////////////////////////////////////////
+// page - PAGE_ID of the registers
+// entries - desired register values
+// count - number of entries, at most CONFIG_MAX_ENTRIES
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::reconcile(uint8_t page, const ConfigEntry *entries, uint8_t count) {
+  uint8_t regAddrs[CONFIG_MAX_ENTRIES];
+  int16_t values[CONFIG_MAX_ENTRIES];
+  if (count > CONFIG_MAX_ENTRIES)
+    count = CONFIG_MAX_ENTRIES;
+  for (uint8_t i = 0; i < count; i++)
+    regAddrs[i] = entries[i].regAddr;
+  regWrite(PAGE_ID, page);
+  regReadBurst(regAddrs, count, values);
+
+  int written = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if ((uint16_t)values[i] != entries[i].value) {
+      regWrite(entries[i].regAddr, entries[i].value);
+      written++;
+    }
+  }
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Applies the desired gateway configuration. An unchanged configuration
+// costs one register burst and no flash write.
+////////////////////////////////////////////////////////////////////////////
+// config - desired gateway settings
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::reconcileGateway(const GatewayConfig &config) {
+  ConfigEntry entries[CONFIG_MAX_ENTRIES];
+  int written = reconcile(0x00, entries, gatewayEntries(config, entries));
+  if (written > 0 && saveGatewaySettings() != 1)
+    return -1;
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Applies the desired configuration of one sensor. Only when a register
+// differs are the settings pushed over the radio and saved, so an
+// unchanged sensor costs no radio traffic and no FLASH_CNT_S count.
+////////////////////////////////////////////////////////////////////////////
+// config - desired sensor settings
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::reconcileSensor(const SensorConfig &config) {
+  ConfigEntry entries[CONFIG_MAX_ENTRIES];
+  int written = reconcile(config.page, entries, sensorEntries(config, entries));
+  if (written > 0 && saveSensorSettings(config.page) != 1)
+    return -1;
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Applies the desired configuration of one sensor without saving it. A
+// change only requests a save, which flushSaves commits together with any
+// further changes made inside the save window.
+////////////////////////////////////////////////////////////////////////////
+// config - desired sensor settings
+// saves - save coalescer
+// now - current time from millis()
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::reconcileSensor(const SensorConfig &config, SaveCoalescer &saves, uint32_t now) {
+  ConfigEntry entries[CONFIG_MAX_ENTRIES];
+  int written = reconcile(config.page, entries, sensorEntries(config, entries));
+  if (written > 0 && saves.request(config.page, now) < 0)
+    return -1;
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Writes alarm bands as one register sequence: a single page select,
+// then ALM_PNTR and the six band registers per band, then ALM_CTRL.
+// Settings are not saved; use saveSensorSettings or a SaveCoalescer.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page
+// bands - bands from compileAlarmBands or ALARM_BIN/ALARM_LSB tables
+// count - number of bands, at most ALARM_MAX_BANDS
+// almCtrl - ALM_CTRL value enabling the alarms
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::writeAlarmBands(uint8_t sensorAddr, const AlarmBandRegs *bands, uint8_t count, uint16_t almCtrl) {
+  if (count > ALARM_MAX_BANDS)
+    count = ALARM_MAX_BANDS;
+  regWrite(PAGE_ID, sensorAddr);
+  for (uint8_t i = 0; i < count; i++) {
+    regWrite(ALM_PNTR, i);
+    regWrite(ALM_F_LOW, bands[i].fLow);
+    regWrite(ALM_F_HIGH, bands[i].fHigh);
+    regWrite(ALM_X_MAG1, bands[i].xMag1);
+    regWrite(ALM_Y_MAG1, bands[i].yMag1);
+    regWrite(ALM_X_MAG2, bands[i].xMag2);
+    regWrite(ALM_Y_MAG2, bands[i].yMag2);
+  }
+  regWrite(ALM_CTRL, almCtrl);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Folds register values into a CRC16, low byte first.
+////////////////////////////////////////////////////////////////////////////
+static uint16_t crcValues(uint16_t crc, const int16_t *values, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    crc = crc16Update(crc, (uint8_t)values[i]);
+    crc = crc16Update(crc, (uint8_t)((uint16_t)values[i] >> 8));
+  }
+  return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the saved configuration registers of a page in one burst and
+// returns their CRC16, to compare against the last committed settings.
+// On a sensor page every alarm band is folded in as well, walking
+// ALM_PNTR, so a change to band thresholds alone is not skipped.
+////////////////////////////////////////////////////////////////////////////
+// page - 0 for the gateway, else a sensor page
+////////////////////////////////////////////////////////////////////////////
+uint16_t ADIS16000::configSnapshot(uint8_t page) {
+  static const uint8_t bandRegisters[] = { ALM_F_LOW, ALM_F_HIGH, ALM_X_MAG1, ALM_Y_MAG1, ALM_X_MAG2, ALM_Y_MAG2 };
+  const uint8_t *regAddrs;
+  int16_t values[CONFIG_MAX_ENTRIES];
+  uint8_t count = configRegisters(page, &regAddrs);
+  regWrite(PAGE_ID, page);
+  regReadBurst(regAddrs, count, values);
+  uint16_t crc = crcValues(0xFFFF, values, count);
+  if (page == 0)
+    return crc;
+  for (uint8_t band = 0; band < ALARM_MAX_BANDS; band++) {
+    regWrite(ALM_PNTR, band);
+    regReadBurst(bandRegisters, sizeof(bandRegisters), values);
+    crc = crcValues(crc, values, sizeof(bandRegisters));
+  }
+  return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the flash write counter of the gateway or a sensor.
+////////////////////////////////////////////////////////////////////////////
+// page - 0 for the gateway, else a sensor page
+////////////////////////////////////////////////////////////////////////////
+uint16_t ADIS16000::readFlashCount(uint8_t page) {
+  regWrite(PAGE_ID, page);
+  return (uint16_t)regRead(page == 0 ? FLASH_CNT_G : FLASH_CNT_S);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Commits due saves. Each page's settings are snapshotted first; if they
+// match what was last committed (a change and its revert inside one
+// window, say) the flash write is skipped. FLASH_CNT is read back after
+// every save and kept in the slot as a wear metric.
+////////////////////////////////////////////////////////////////////////////
+// saves - save coalescer
+// now - current time from millis()
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::flushSaves(SaveCoalescer &saves, uint32_t now) {
+  int written = 0;
+  int8_t index;
+  while ((index = saves.due(now)) != SAVE_NONE) {
+    SaveSlot &slot = saves.slot(index);
+    uint16_t snapshot = configSnapshot(slot.page);
+    if (slot.committed && snapshot == slot.snapshot) {
+      saves.finished(index, now, SAVE_SKIPPED, snapshot, slot.flashCount);
+      continue;
+    }
+    int result = slot.page == 0 ? saveGatewaySettings() : saveSensorSettings(slot.page);
+    if (result != 1) {
+      saves.finished(index, now, SAVE_FAILED, snapshot, slot.flashCount);
+      continue;
+    }
+    saves.finished(index, now, SAVE_COMMITTED, snapshot, readFlashCount(slot.page));
+    written++;
+  }
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Asserts _RST and returns at once. Call pollReset until it returns 1.
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::beginReset() {
+  digitalWrite(_RST, LOW);
+  _resetStart = micros();
+  _resetState = 1;
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Advances a non-blocking reset. Releases _RST after RESET_PULSE_US, then
+// reads PROD_ID_G on a backoff schedule until the gateway answers. Every
+// call returns immediately, so the caller can keep serving other work
+// while the gateway boots.
+////////////////////////////////////////////////////////////////////////////
+// timeoutUs - time allowed from beginReset until the gateway answers
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::pollReset(uint32_t timeoutUs) {
+  uint32_t now = micros();
+  if (_resetState == 0)
+    return 1;
+  if (_resetState == 1) {
+    if (now - _resetStart < RESET_PULSE_US)
+      return 0;
+    digitalWrite(_RST, HIGH);
+    _resetState = 2;
+    _resetNext = now;
+    _resetBackoff = CMD_POLL_US;
+  }
+  if ((int32_t)(now - _resetNext) < 0)
+    return 0;
+  if ((uint16_t)regRead(PROD_ID_G) == ADIS16000_PROD_ID) {
+    _resetState = 0;
+    return 1;
+  }
+  if (now - _resetStart >= timeoutUs) {
+    _resetState = 0;
+    return -1;
+  }
+  _resetNext = now + _resetBackoff;
+  if (_resetBackoff < CMD_POLL_MAX_US)
+    _resetBackoff = _resetBackoff * 2 > CMD_POLL_MAX_US ? CMD_POLL_MAX_US : _resetBackoff * 2;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Brings up the network after a gateway restart. The gateway keeps its
+// network and the sensors keep their settings in flash, so after a
+// brown-out usually nothing needs to be written: NETWORK_ID, enrollment
+// (PROD_ID_S reads ADIS16229_PROD_ID on the sensor page) and
+// UPDAT_INT/INT_SCL are read first, and only the differences are
+// enrolled, configured and saved.
+////////////////////////////////////////////////////////////////////////////
+// networkId - desired NETWORK_ID
+// sensorAddrs - sensor pages
+// count - number of sensors
+// interval, scalefactor - periodic mode, as passed to setPeriodicMode
+// status - receives BATCH_SKIPPED for sensors that already matched, else the BATCH_ result
+// return - number of sensors skipped or brought up, -1 if the gateway save failed
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::restoreNetwork(uint16_t networkId, const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status) {
+  uint8_t changed = 0;
+  regWrite(PAGE_ID, 0x00);
+  uint8_t sameNetwork = (uint16_t)regRead(NETWORK_ID) == networkId;
+  if (!sameNetwork) {
+    regWrite(NETWORK_ID, networkId);
+    changed = 1;
+  }
+
+  // Enrollment
+  uint8_t enroll = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    status[i] = BATCH_PENDING;
+    if (sameNetwork) {
+      regWrite(PAGE_ID, sensorAddrs[i]);
+      if ((uint16_t)regRead(PROD_ID_S) == ADIS16229_PROD_ID)
+        status[i] = BATCH_SKIPPED;
+    }
+    if (status[i] == BATCH_PENDING)
+      enroll = 1;
+  }
+  if (enroll) {
+    batchGateway(CMD_G_ADD_SENSOR, sensorAddrs, count, status, 1);
+    changed = 1;
+  }
+
+  // Periodic mode of sensors that were already enrolled and match stays untouched
+  uint8_t configure = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (status[i] == BATCH_SKIPPED) {
+      regWrite(PAGE_ID, sensorAddrs[i]);
+      if ((uint16_t)regRead(UPDAT_INT) != interval || (uint16_t)regRead(INT_SCL) != scalefactor)
+        status[i] = BATCH_PENDING;
+    }
+    else if (status[i] == BATCH_OK)
+      status[i] = BATCH_PENDING;
+    if (status[i] == BATCH_PENDING)
+      configure = 1;
+  }
+  if (configure)
+    batchConfigure(sensorAddrs, count, interval, scalefactor, status, 1);
+  if (changed && saveGatewaySettings() != 1) {
+    regWrite(PAGE_ID, 0x00);
+    return -1;
+  }
+
+  int ready = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (status[i] == BATCH_OK || status[i] == BATCH_SKIPPED)
+      ready++;
+  }
+  regWrite(PAGE_ID, 0x00);
+  return ready;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Polls a command or status register until the mask bits read back
+// clear. The first polls come quickly and the interval doubles up to
+// CMD_POLL_MAX_US, so fast commands return at the device's own speed and
+// slow ones do not flood the SPI bus.
+////////////////////////////////////////////////////////////////////////////
+// page - PAGE_ID to poll on (0 for the gateway)
+// regAddr - register to poll
+// mask - bits that are set while the command is running
+// timeoutUs - longest time to wait
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::waitCommand(uint8_t page, uint8_t regAddr, uint16_t mask, uint32_t timeoutUs) {
+  uint32_t start = micros();
+  uint16_t backoff = CMD_POLL_US;
+  regWrite(PAGE_ID, page);
+  while (regRead(regAddr) & mask) {
+    uint32_t elapsed = micros() - start;
+    if (elapsed >= timeoutUs)
+      return 0;
+    delayMicroseconds(backoff < timeoutUs - elapsed ? backoff : timeoutUs - elapsed);
+    if (backoff < CMD_POLL_MAX_US)
+      backoff = backoff * 2 > CMD_POLL_MAX_US ? CMD_POLL_MAX_US : backoff * 2;
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Issues a gateway command for one sensor and waits for it to finish.
+////////////////////////////////////////////////////////////////////////////
+// command - CMD_G_ADD_SENSOR or CMD_G_REMOVE_SENSOR
+// sensorAddr - sensor page
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::gatewayCommand(uint16_t command, uint8_t sensorAddr) {
+  if (!waitCommand(0x00, GLOB_CMD_G, 0xFFFF, CMD_TIMEOUT_US))
+    return 0;
+  regWrite(CMD_DATA, sensorAddr);
+  regWrite(GLOB_CMD_G, command);
+  if (!waitCommand(0x00, GLOB_CMD_G, command, CMD_TIMEOUT_US))
+    return 0;
+  return (regRead(NW_ERROR_STAT) & NW_ERR_CMD_MASK) ? -1 : 1;
+}
+
+int ADIS16000::addSensor(uint8_t sensorAddr) {
+	return gatewayCommand(CMD_G_ADD_SENSOR, sensorAddr);
 }
 
 int ADIS16000::removeSensor(uint8_t sensorAddr) {
-	regWrite(CMD_DATA, sensorAddr);
-	regWrite(GLOB_CMD_G, 0x100);
-	return 1;
+	return gatewayCommand(CMD_G_REMOVE_SENSOR, sensorAddr);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Issues one gateway command per sensor. A command is not waited for
+// after it is issued; its completion is polled just before the next one,
+// so each sensor costs the gateway's real command time instead of a
+// worst-case delay. The NW_ERR_CMD_MASK bits of NW_ERROR_STAT are checked
+// after every completion.
+////////////////////////////////////////////////////////////////////////////
+// command - CMD_G_ADD_SENSOR or CMD_G_REMOVE_SENSOR
+// sensorAddrs - sensor pages
+// count - number of sensors
+// status - receives a BATCH_ result per sensor
+// skip - only issue entries marked BATCH_PENDING, leaving the others untouched
+// return - number of sensors that completed without error
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::batchGateway(uint16_t command, const uint8_t *sensorAddrs, uint8_t count, uint8_t *status, uint8_t skip) {
+  int done = 0;
+  int16_t issued = -1;
+  for (uint8_t i = 0; i <= count; i++) {
+    if (i < count && skip && status[i] != BATCH_PENDING)
+      continue;
+    uint8_t idle = waitCommand(0x00, GLOB_CMD_G, 0xFFFF, CMD_TIMEOUT_US);
+    if (issued >= 0) {
+      if (!idle)
+        status[issued] = BATCH_TIMEOUT;
+      else if (regRead(NW_ERROR_STAT) & NW_ERR_CMD_MASK)
+        status[issued] = BATCH_ERROR;
+      else {
+        status[issued] = BATCH_OK;
+        done++;
+      }
+      issued = -1;
+    }
+    if (i == count)
+      break;
+    if (!idle) {
+      status[i] = BATCH_TIMEOUT;
+      continue;
+    }
+    regWrite(CMD_DATA, sensorAddrs[i]);
+    regWrite(GLOB_CMD_G, command);
+    status[i] = BATCH_PENDING;
+    issued = i;
+  }
+  return done;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Adds a list of sensors to the network. CMD_DATA is written before the
+// command, so the gateway never waits for the sensor ID.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddrs - sensor pages
+// count - number of sensors
+// status - receives a BATCH_ result per sensor
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::addSensors(const uint8_t *sensorAddrs, uint8_t count, uint8_t *status) {
+  return batchGateway(CMD_G_ADD_SENSOR, sensorAddrs, count, status, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Removes a list of sensors from the network.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddrs - sensor pages
+// count - number of sensors
+// status - receives a BATCH_ result per sensor
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::removeSensors(const uint8_t *sensorAddrs, uint8_t count, uint8_t *status) {
+  return batchGateway(CMD_G_REMOVE_SENSOR, sensorAddrs, count, status, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Sets periodic mode on a list of sensors and saves their settings. The
+// commands to all sensors are sent first, then every sensor's GLOB_CMD_S
+// is polled in turn until it is acknowledged, so the radio round trips
+// of the whole list overlap instead of adding up.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddrs - sensor pages
+// count - number of sensors
+// interval, scalefactor - as passed to setPeriodicMode
+// status - receives a BATCH_ result per sensor
+// return - number of sensors that acknowledged
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::configureSensors(const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status) {
+  return batchConfigure(sensorAddrs, count, interval, scalefactor, status, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Body of configureSensors. With skip set, only entries marked
+// BATCH_PENDING are written; the others keep their status.
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::batchConfigure(const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status, uint8_t skip) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (skip && status[i] != BATCH_PENDING)
+      continue;
+    if (!waitCommand(0x00, GLOB_CMD_G, 0xFFFF, CMD_TIMEOUT_US)) {
+      status[i] = BATCH_TIMEOUT;
+      continue;
+    }
+    regWrite(PAGE_ID, sensorAddrs[i]);
+    regWrite(UPDAT_INT, interval);
+    regWrite(INT_SCL, scalefactor);
+    regWrite(GLOB_CMD_S, CMD_S_FLASH_UPDATE | CMD_S_START);
+    regWrite(PAGE_ID, 0x00);
+    regWrite(GLOB_CMD_G, CMD_G_SEND_DATA);
+    status[i] = BATCH_PENDING;
+  }
+
+  uint32_t start = micros();
+  uint16_t backoff = CMD_POLL_US;
+  uint8_t pending = 1;
+  while (pending) {
+    pending = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      if (status[i] != BATCH_PENDING)
+        continue;
+      regWrite(PAGE_ID, sensorAddrs[i]);
+      if ((regRead(GLOB_CMD_S) & (CMD_S_FLASH_UPDATE | CMD_S_START)) == 0)
+        status[i] = BATCH_OK;
+      else
+        pending = 1;
+    }
+    if (pending && micros() - start >= CMD_SENSOR_TIMEOUT_US)
+      break;
+    if (pending) {
+      delayMicroseconds(backoff);
+      if (backoff < CMD_POLL_MAX_US)
+        backoff = backoff * 2 > CMD_POLL_MAX_US ? CMD_POLL_MAX_US : backoff * 2;
+    }
+  }
+
+  int done = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (status[i] == BATCH_PENDING)
+      status[i] = BATCH_TIMEOUT;
+    if (status[i] == BATCH_OK)
+      done++;
+  }
+  regWrite(PAGE_ID, 0x00);
+  return done;
 }
 
 int ADIS16000::saveGatewaySettings() {
 	regWrite(PAGE_ID, 0x00);
-	regWrite(GLOB_CMD_G, 0x40);
-	return 1;
+	regWrite(GLOB_CMD_G, CMD_G_FLASH_UPDATE);
+	if (!waitCommand(0x00, GLOB_CMD_G, CMD_G_FLASH_UPDATE, CMD_TIMEOUT_US))
+		return 0;
+	return (regRead(DIAG_STAT_G) & DIAG_G_FLASH_FAIL) ? -1 : 1;
 }
 
 int ADIS16000::saveSensorSettings(uint8_t sensorAddr) {
 	regWrite(PAGE_ID, sensorAddr);
-	regWrite(GLOB_CMD_S, 0x40);
+	regWrite(GLOB_CMD_S, CMD_S_FLASH_UPDATE);
 	regWrite(PAGE_ID, 0x00);
-	regWrite(GLOB_CMD_G, 0x02);
-	return 1;
+	regWrite(GLOB_CMD_G, CMD_G_SEND_DATA);
+	if (!waitCommand(0x00, GLOB_CMD_G, CMD_G_SEND_DATA, CMD_TIMEOUT_US))
+		return 0;
+	return waitCommand(sensorAddr, GLOB_CMD_S, CMD_S_FLASH_UPDATE, CMD_SENSOR_TIMEOUT_US);
 }
 
 int16_t * ADIS16000::readFFTBuffer(uint8_t sensorAddr) {
@@ -183,6 +689,275 @@ int16_t * ADIS16000::readFFTBuffer(uint8_t sensorAddr) {
 	return buffer;
 }
 
+////////////////////////////////////////////////////////////////////////////
+// Reads the current FFT record of both axes one bin at a time. Nothing is
+// buffered, so handler can reduce the record while it is read.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// handler - called with the bin index and the X and Y magnitudes
+// context - passed through to handler
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTStream(uint8_t sensorAddr, FFTBinHandler handler, void *context) {
+  return readFFTBand(sensorAddr, 0, FFT_BINS, handler, context);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads part of the current FFT record of both axes. Used for degraded
+// polls, where only a band of interest is worth the bus time.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// firstBin - first bin to read
+// count - number of bins to read
+// handler - called with the bin index and the X and Y magnitudes
+// context - passed through to handler
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTBand(uint8_t sensorAddr, uint8_t firstBin, uint16_t count, FFTBinHandler handler, void *context) {
+  if ((uint16_t)firstBin + count > FFT_BINS)
+    count = FFT_BINS - firstBin;
+  regWrite(PAGE_ID, sensorAddr);
+  regWrite(BUF_PNTR, firstBin);
+  for (uint16_t i = 0; i < count; i++) {
+    int16_t xData = regRead(X_BUF);
+    int16_t yData = regRead(Y_BUF);
+    handler((uint8_t)(firstBin + i), xData, yData, context);
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the peak magnitude and frequency the sensor reports for its
+// latest record, for polls degraded to features only.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// features - receives the features
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFeatures(uint8_t sensorAddr, SensorFeatures &features) {
+  features.page = sensorAddr;
+  features.timestamp = readTimestamp(sensorAddr);
+  features.xPeak = regRead(ALM_X_PEAK);
+  features.yPeak = regRead(ALM_Y_PEAK);
+  features.xFreq = regRead(ALM_X_FREQ);
+  features.yFreq = regRead(ALM_Y_FREQ);
+  features.temperature = regRead(TEMP_OUT_S);
+  return 1;
+}
+
+static void pushPeakBins(uint8_t, int16_t xData, int16_t yData, void *context) {
+  SpectrumPeakPicker **pickers = (SpectrumPeakPicker **)context;
+  pickers[0]->push(xData);
+  pickers[1]->push(yData);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record and keeps only the largest peaks of each axis.
+// Pickers must be started with begin() before the call.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// xPicker, yPicker - peak pickers for each axis, finished on return
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTPeaks(uint8_t sensorAddr, SpectrumPeakPicker &xPicker, SpectrumPeakPicker &yPicker) {
+  SpectrumPeakPicker *pickers[2] = { &xPicker, &yPicker };
+  readFFTStream(sensorAddr, pushPeakBins, pickers);
+  xPicker.finish();
+  yPicker.finish();
+  return 1;
+}
+
+static void pushCrossAxisBins(uint8_t bin, int16_t xData, int16_t yData, void *context) {
+  ((CrossAxisAnalyzer *)context)->push(bin, xData, yData);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record and computes X/Y ratio, vector magnitude and
+// directionality in the same pass. Analyzer must be started with begin().
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// analyzer - cross-axis analyzer for the record
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTCrossAxis(uint8_t sensorAddr, CrossAxisAnalyzer &analyzer) {
+  readFFTStream(sensorAddr, pushCrossAxisBins, &analyzer);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the registers that go into a binary record header.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// header - receives the header fields, count is set to FFT_BINS
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readRecordHeader(uint8_t sensorAddr, uint8_t gRange, RecordHeader &header) {
+  regWrite(PAGE_ID, sensorAddr);
+  uint16_t timeLow = regRead(TIME_STMP_L);
+  uint16_t timeHigh = regRead(TIME_STMP_H);
+  header.page = sensorAddr;
+  header.timestamp = ((uint32_t)timeHigh << 16) | timeLow;
+  header.range = gRange;
+  header.flags = RECORD_FFT;
+  header.avgCnt = regRead(AVG_CNT);
+  header.temperature = regRead(TEMP_OUT_S);
+  header.supply = regRead(SUPPLY_OUT_S);
+  header.rssi = regRead(RSSI_S);
+  header.count = FFT_BINS;
+  return 1;
+}
+
+static void writeRecordBins(uint8_t bin, int16_t xData, int16_t yData, void *context) {
+  writeRecordPair((uint8_t *)context, bin, xData, yData);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record of both axes into a binary record. Bins are packed
+// into place as they are read, so no intermediate spectrum is kept.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// record - RECORD_SIZE(FFT_BINS) bytes
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTRecord(uint8_t sensorAddr, uint8_t gRange, uint8_t *record) {
+  RecordHeader header;
+  readRecordHeader(sensorAddr, gRange, header);
+  writeRecordHeader(record, header);
+  readFFTStream(sensorAddr, writeRecordBins, record);
+  return 1;
+}
+
+static void streamRecordBins(uint8_t, int16_t xData, int16_t yData, void *context) {
+  FrameWriter *writer = (FrameWriter *)context;
+  uint8_t pair[4];
+  putLE16(pair, (uint16_t)xData);
+  putLE16(pair + 2, (uint16_t)yData);
+  writer->write(pair, 4);
+  writer->pump();
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record and frames it as a binary record while it is read.
+// The writer is pumped after every bin, so earlier frames keep draining
+// to the serial port during the SPI reads. Call writer.pump() between
+// records to finish sending the frame.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// writer - frame writer attached to the output port
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::streamFFTRecord(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer) {
+  RecordHeader header;
+  uint8_t headerData[RECORD_HEADER_SIZE];
+  readRecordHeader(sensorAddr, gRange, header);
+  writeRecordHeader(headerData, header);
+  writer.begin();
+  writer.write(headerData, RECORD_HEADER_SIZE);
+  readFFTStream(sensorAddr, streamRecordBins, &writer);
+  writer.end();
+  writer.pump();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record and frames only its largest peaks, about a
+// thirteenth of a full record. Axes with fewer peaks are padded with
+// zero magnitude entries.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// writer - frame writer attached to the output port
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::streamFFTPeaks(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer) {
+  SpectrumPeak peaks[2][SHED_PEAK_COUNT];
+  SpectrumPeakPicker xPicker, yPicker;
+  RecordHeader header;
+  uint8_t data[RECORD_HEADER_SIZE];
+  readRecordHeader(sensorAddr, gRange, header);
+  xPicker.begin(peaks[0], SHED_PEAK_COUNT, PEAK_INTERP_PARABOLIC);
+  yPicker.begin(peaks[1], SHED_PEAK_COUNT, PEAK_INTERP_PARABOLIC);
+  readFFTPeaks(sensorAddr, xPicker, yPicker);
+  header.flags = RECORD_FFT | RECORD_PEAKS;
+  header.count = 2 * SHED_PEAK_COUNT;
+  writeRecordHeader(data, header);
+  writer.begin();
+  writer.write(data, RECORD_HEADER_SIZE);
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    uint8_t found = axis == 0 ? xPicker.count() : yPicker.count();
+    for (uint8_t i = 0; i < SHED_PEAK_COUNT; i++) {
+      putLE16(data, i < found ? peaks[axis][i].position : 0);
+      putLE16(data + 2, i < found ? (uint16_t)peaks[axis][i].magnitude : 0);
+      writer.write(data, 4);
+    }
+  }
+  writer.end();
+  writer.pump();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Frames the alarm peak features of the latest record. No FFT data is
+// read, so this is the cheapest record on both SPI and the output link.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// writer - frame writer attached to the output port
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::streamFeatures(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer) {
+  RecordHeader header;
+  uint8_t data[RECORD_SIZE(2)];
+  readRecordHeader(sensorAddr, gRange, header);
+  header.flags = RECORD_FEATURES;
+  header.count = 2;
+  writeRecordHeader(data, header);
+  writeRecordPair(data, 0, regRead(ALM_X_PEAK), regRead(ALM_Y_PEAK));
+  writeRecordPair(data, 1, regRead(ALM_X_FREQ), regRead(ALM_Y_FREQ));
+  writer.begin();
+  writer.write(data, sizeof(data));
+  writer.end();
+  writer.pump();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Frames the latest record of a sensor, shedding to peaks or features
+// while the output queue is backed up instead of blocking on a full
+// record. The shedder counts every record by payload.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// gRange - measurement range in g, as passed to scaleFFT
+// priority - PRIORITY_ class of the sensor
+// shedder - load shedder for the output link
+// writer - frame writer attached to the output port
+////////////////////////////////////////////////////////////////////////////
+uint8_t ADIS16000::streamShedRecord(uint8_t sensorAddr, uint8_t gRange, uint8_t priority, LoadShedder &shedder, FrameWriter &writer) {
+  writer.pump();
+  shedder.update(writer.pending());
+  uint8_t payload = shedder.payload(priority);
+  if (payload == SHED_FULL)
+    streamFFTRecord(sensorAddr, gRange, writer);
+  else if (payload == SHED_PEAKS)
+    streamFFTPeaks(sensorAddr, gRange, writer);
+  else
+    streamFeatures(sensorAddr, gRange, writer);
+  shedder.sent(payload);
+  return payload;
+}
+
+static void encodeLog8Bins(uint8_t bin, int16_t xData, int16_t yData, void *context) {
+  uint8_t **codes = (uint8_t **)context;
+  codes[0][bin] = log8Encode(xData);
+  codes[1][bin] = log8Encode(yData);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the FFT record and stores it log8 encoded, half the size of the
+// raw record. See log8Encode for the error bounds.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// xCodes, yCodes - 256 bytes each
+////////////////////////////////////////////////////////////////////////////
+int ADIS16000::readFFTLog8(uint8_t sensorAddr, uint8_t *xCodes, uint8_t *yCodes) {
+  uint8_t *codes[2] = { xCodes, yCodes };
+  readFFTStream(sensorAddr, encodeLog8Bins, codes);
+  return 1;
+}
+
 int16_t * ADIS16000::readFFT(uint8_t sample, uint8_t sensorAddr) {
 	int16_t buffer [2];
 	regWrite(PAGE_ID, sensorAddr);
@@ -212,8 +987,47 @@ int ADIS16000::setPeriodicMode(uint16_t interval, uint8_t scalefactor, uint8_t s
   regWrite(PAGE_ID, sensorAddr);
   regWrite(UPDAT_INT, interval);
   regWrite(INT_SCL, scalefactor);
-  regWrite(GLOB_CMD_S, 0x800);
-  return 1;
+  regWrite(GLOB_CMD_S, CMD_S_START);
+  if (!waitCommand(0x00, GLOB_CMD_G, 0xFFFF, CMD_TIMEOUT_US))
+    return 0;
+  regWrite(GLOB_CMD_G, CMD_G_SEND_DATA);
+  if (!waitCommand(0x00, GLOB_CMD_G, CMD_G_SEND_DATA, CMD_TIMEOUT_US))
+    return 0;
+  return waitCommand(sensorAddr, GLOB_CMD_S, CMD_S_START, CMD_SENSOR_TIMEOUT_US);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads the timestamp of the latest record. Comparing it with the last
+// value seen tells a scheduler whether a new record has arrived.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// return - TIME_STMP_H:TIME_STMP_L
+////////////////////////////////////////////////////////////////////////////
+uint32_t ADIS16000::readTimestamp(uint8_t sensorAddr) {
+  regWrite(PAGE_ID, sensorAddr);
+  uint16_t timeLow = regRead(TIME_STMP_L);
+  uint16_t timeHigh = regRead(TIME_STMP_H);
+  return ((uint32_t)timeHigh << 16) | timeLow;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Reads when the gateway received the latest record of a sensor. Unlike
+// the poll time, this is not delayed by polling, so it shows the real
+// arrival pattern of the sensor.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page to read
+// return - PKT_TIME_H:PKT_TIME_L in milliseconds
+////////////////////////////////////////////////////////////////////////////
+uint32_t ADIS16000::readPacketTime(uint8_t sensorAddr) {
+  regWrite(PAGE_ID, sensorAddr);
+  uint16_t timeLow = regRead(PKT_TIME_L);
+  uint16_t timeHigh = regRead(PKT_TIME_H);
+  uint32_t ticks = ((uint32_t)timeHigh << 16) | timeLow;
+#if PKT_TIME_UNIT_US == 1000
+  return ticks;
+#else
+  return (uint32_t)(((uint64_t)ticks * PKT_TIME_UNIT_US) / 1000);
+#endif
 }
 
 float ADIS16000::scaleTime(int16_t sensorData, int gRange {
@@ -22,8 +22,17 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifndef ADIS16000_H
+#define ADIS16000_H
+
 #include "Arduino.h"
 #include <SPI.h>
+#include "ADIS16000Spectrum.h"
+#include "ADIS16000Record.h"
+#include "ADIS16000Stream.h"
+#include "ADIS16000Codec.h"
+#include "ADIS16000Scheduler.h"
+#include "ADIS16000Config.h"
 
 // Uncomment for DEBUG mode
 //#define DEBUG
@@ -99,6 +108,55 @@
 #define LOT_ID1_S		0x68
 #define LOT_ID2_S		0x6A
 
+// GLOB_CMD_G commands. Bits clear when the gateway has finished the command.
+#define CMD_G_ADD_SENSOR	0x0001
+#define CMD_G_SEND_DATA		0x0002
+#define CMD_G_FLASH_UPDATE	0x0040
+#define CMD_G_REMOVE_SENSOR	0x0100
+
+// GLOB_CMD_S commands. Bits clear when the sensor has acknowledged the command.
+#define CMD_S_FLASH_UPDATE	0x0040
+#define CMD_S_START			0x0800
+
+// DIAG_STAT_G bit that fails a gateway flash update. Other bits (supply,
+// SPI) do not reflect on the command.
+#define DIAG_G_FLASH_FAIL	0x0004
+
+// NW_ERROR_STAT bits that fail an add or remove sensor command
+#define NW_ERR_COMMAND		0x0001
+#define NW_ERR_NETWORK		0x0002
+#define NW_ERR_CMD_MASK		(NW_ERR_COMMAND | NW_ERR_NETWORK)
+
+// Command completion timeouts: gateway-local and over the radio link
+#define CMD_TIMEOUT_US			100000UL
+#define CMD_SENSOR_TIMEOUT_US	2000000UL
+
+// Completion polls back off exponentially from CMD_POLL_US to CMD_POLL_MAX_US between reads
+#define CMD_POLL_US			20
+#define CMD_POLL_MAX_US		5000
+
+// PROD_ID_G value once the gateway is out of reset
+#define ADIS16000_PROD_ID	16000
+
+// PROD_ID_S value of an enrolled sensor
+#define ADIS16229_PROD_ID	16229
+
+// Per-sensor result of a batch command
+#define BATCH_OK			0
+#define BATCH_PENDING		1
+#define BATCH_TIMEOUT		2
+#define BATCH_ERROR			3
+#define BATCH_SKIPPED		4	// Already in the desired state, nothing written
+
+// Non-blocking reset: RST low time, and the gateway page is polled for PROD_ID_G after release
+#define RESET_PULSE_US		10000UL
+
+// Longest time resetDUT waits for the gateway to answer
+#define RESET_TIMEOUT_US	2000000UL
+
+// Microseconds per PKT_TIME count
+#define PKT_TIME_UNIT_US	1000UL
+
 //ADIS16000/ADIS16229 Class Definition
 class ADIS16000{
 
@@ -109,7 +167,7 @@ public:
 	// Destructor
 	~ADIS16000();
 
-	// Performs hardware reset. Delay in milliseconds. Returns 1 when complete.
+	// Performs hardware reset and waits for the gateway to answer, and at least ms milliseconds after release. Returns 1 when complete, 0 on timeout.
 	int resetDUT(uint8_t ms);
 
 	// Sets SPI bit order, clock divider, and data mode. Returns 1 when complete.
@@ -121,21 +179,105 @@ public:
   	// Write register (two bytes). Returns 1 when complete.
   	int regWrite(uint8_t regAddr, uint16_t regData);
 
-  	// Add sensor to network. Returns 1 when complete.
+  	// Reads count registers of the current page, each frame clocking out the previous register. Returns 1 when complete.
+  	int regReadBurst(const uint8_t *regAddrs, uint8_t count, int16_t *values);
+
+  	// Writes the entries of page whose registers differ. Returns the number of registers written.
+  	int reconcile(uint8_t page, const ConfigEntry *entries, uint8_t count);
+
+  	// Applies a gateway configuration, saving to flash only if a register changed. Returns the number of registers written, -1 if the save failed.
+  	int reconcileGateway(const GatewayConfig &config);
+
+  	// Applies a sensor configuration, pushing and saving it only if a register changed. Returns the number of registers written, -1 if the save failed.
+  	int reconcileSensor(const SensorConfig &config);
+
+  	// Applies a sensor configuration and requests a coalesced save if a register changed. Returns the number of registers written, -1 if the save table is full.
+  	int reconcileSensor(const SensorConfig &config, SaveCoalescer &saves, uint32_t now);
+
+  	// Writes compiled alarm bands and ALM_CTRL under one page select. Returns 1 when complete.
+  	int writeAlarmBands(uint8_t sensorAddr, const AlarmBandRegs *bands, uint8_t count, uint16_t almCtrl);
+
+  	// CRC of the configRegisters values of a page and, on sensor pages, of its alarm bands. Returns the snapshot.
+  	uint16_t configSnapshot(uint8_t page);
+
+  	// Reads FLASH_CNT_G (page 0) or FLASH_CNT_S of a sensor. Returns the flash write count.
+  	uint16_t readFlashCount(uint8_t page);
+
+  	// Commits the saves whose window has passed, skipping unchanged snapshots. Returns the number of flash writes made.
+  	int flushSaves(SaveCoalescer &saves, uint32_t now);
+
+  	// Starts a hardware reset without blocking. Returns 1 when complete.
+  	int beginReset();
+
+  	// Advances a reset started by beginReset. Returns 1 when the gateway answers, 0 while waiting, -1 after timeoutUs.
+  	int pollReset(uint32_t timeoutUs);
+
+  	// Brings the network to networkId with the listed sensors in periodic mode, skipping whatever already matches. Returns the number of sensors ready, -1 if the gateway save failed.
+  	int restoreNetwork(uint16_t networkId, const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status);
+
+  	// Add sensor to network. Returns 1 when complete, 0 on timeout, -1 if the gateway reports a network error.
   	int addSensor(uint8_t sensorAddr);
 
-  	// Remove sensor from network. Returns 1 when complete.
+  	// Remove sensor from network. Returns 1 when complete, 0 on timeout, -1 if the gateway reports a network error.
   	int removeSensor(uint8_t sensorAddr);
 
-  	// Save configuration settings for gateway. Returns 1 when complete.
+  	// Adds sensors, issuing each command as soon as the gateway finishes the previous one. Fills status with BATCH_ results. Returns the number added.
+  	int addSensors(const uint8_t *sensorAddrs, uint8_t count, uint8_t *status);
+
+  	// Removes sensors like addSensors. Returns the number removed.
+  	int removeSensors(const uint8_t *sensorAddrs, uint8_t count, uint8_t *status);
+
+  	// Sets periodic mode and saves the settings of all sensors, waiting for their acknowledgements together. Returns the number configured.
+  	int configureSensors(const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status);
+
+  	// Save configuration settings for gateway. Returns 1 when complete, 0 on timeout, -1 if DIAG_STAT_G flags an error.
   	int saveGatewaySettings();
 
-  	// Save configuration settings for selected sensor. Returns 1 when complete.
+  	// Save configuration settings for selected sensor. Returns 1 when acknowledged, 0 on timeout.
   	int saveSensorSettings(uint8_t sensorAddr);
 
+  	// Polls regAddr on page until the mask bits clear, backing off between reads. Returns 1 when clear, 0 on timeout.
+  	int waitCommand(uint8_t page, uint8_t regAddr, uint16_t mask, uint32_t timeoutUs);
+
   	// Reads entire X-Axis FFT buffer. Returns array with 256 samples when complete.
   	int16_t * readFFTBuffer(uint8_t sensorAddr);
 
+  	// Reads the FFT record of both axes, calling handler once per bin. Returns 1 when complete.
+  	int readFFTStream(uint8_t sensorAddr, FFTBinHandler handler, void *context);
+
+  	// Reads count bins of both axes starting at firstBin, calling handler once per bin. Returns 1 when complete.
+  	int readFFTBand(uint8_t sensorAddr, uint8_t firstBin, uint16_t count, FFTBinHandler handler, void *context);
+
+  	// Reads the alarm peak features of the latest record (a few registers). Returns 1 when complete.
+  	int readFeatures(uint8_t sensorAddr, SensorFeatures &features);
+
+  	// Picks the largest X and Y peaks while the FFT record is read. Returns 1 when complete.
+  	int readFFTPeaks(uint8_t sensorAddr, SpectrumPeakPicker &xPicker, SpectrumPeakPicker &yPicker);
+
+  	// Runs cross-axis analysis while the FFT record is read. Returns 1 when complete.
+  	int readFFTCrossAxis(uint8_t sensorAddr, CrossAxisAnalyzer &analyzer);
+
+  	// Reads header registers of the selected sensor. Returns 1 when complete.
+  	int readRecordHeader(uint8_t sensorAddr, uint8_t gRange, RecordHeader &header);
+
+  	// Reads the FFT record straight into a RECORD_SIZE(FFT_BINS) byte binary record. Returns 1 when complete.
+  	int readFFTRecord(uint8_t sensorAddr, uint8_t gRange, uint8_t *record);
+
+  	// Streams the FFT record as one binary record frame, draining writer between reads. Returns 1 when complete.
+  	int streamFFTRecord(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer);
+
+  	// Frames a RECORD_PEAKS record holding the SHED_PEAK_COUNT largest peaks of each axis. Returns 1 when complete.
+  	int streamFFTPeaks(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer);
+
+  	// Frames a RECORD_FEATURES record from the alarm peak registers. Returns 1 when complete.
+  	int streamFeatures(uint8_t sensorAddr, uint8_t gRange, FrameWriter &writer);
+
+  	// Frames the record payload the shedder picks for the output backlog and sensor priority. Returns the SHED_ payload sent.
+  	uint8_t streamShedRecord(uint8_t sensorAddr, uint8_t gRange, uint8_t priority, LoadShedder &shedder, FrameWriter &writer);
+
+  	// Reads the FFT record of both axes as 8-bit log8 codes (256 bytes per axis). Returns 1 when complete.
+  	int readFFTLog8(uint8_t sensorAddr, uint8_t *xCodes, uint8_t *yCodes);
+
   	// Reads single FFT sample from both (X & Y) axis. Returns single sample when complete. 
   	int16_t * readFFT(uint8_t sample, uint8_t sensorAddr);
 
@@ -145,7 +287,14 @@ public:
   	// Reads entire time buffer when DataReady transitions. Returns array with 512 samples.
   	int16_t * readTimeBuffer();
 
-    int setPeriodicMode(uint16_t interval, uint8_t scalefactor, uint8_t sensorAddr);
+  	// Sets the periodic record interval of a sensor and starts it. Returns 1 when acknowledged, 0 on timeout.
+  	int setPeriodicMode(uint16_t interval, uint8_t scalefactor, uint8_t sensorAddr);
+
+  	// Reads the 32-bit TIME_STMP of the latest record of the selected sensor. Returns the timestamp.
+  	uint32_t readTimestamp(uint8_t sensorAddr);
+
+  	// Reads the gateway packet time of the latest record of the selected sensor. Returns time in ms.
+  	uint32_t readPacketTime(uint8_t sensorAddr);
 
   	// Scales single time sample. Returns acceleration in mg.
   	float scaleTime(int16_t sensorData, int gRange);
@@ -160,7 +309,17 @@ public:
   	float scaleTemp(int16_t sensorData);
 
 private:
+	int gatewayCommand(uint16_t command, uint8_t sensorAddr);
+	int batchGateway(uint16_t command, const uint8_t *sensorAddrs, uint8_t count, uint8_t *status, uint8_t skip);
+	int batchConfigure(const uint8_t *sensorAddrs, uint8_t count, uint16_t interval, uint8_t scalefactor, uint8_t *status, uint8_t skip);
+
 	int _CS;
 	int _RST;
+	uint8_t _resetState;
+	uint32_t _resetStart;
+	uint32_t _resetNext;
+	uint16_t _resetBackoff;
 
 };
+
+#endif
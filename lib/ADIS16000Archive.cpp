@@ -0,0 +1,467 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Archive.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Append-only spectrum archive built from fixed-size segments of binary records. A segment is a
+//  plain memory region (on a Linux host, typically an mmap of a segment file), so records are read
+//  back as views into that memory without parsing or copying.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Archive.h"
+
+// Slot trailer: next slot of the same sensor and the record length
+#define SLOT_OFS_NEXT		(ARCHIVE_SLOT_SIZE - 4)
+#define SLOT_OFS_LENGTH		(ARCHIVE_SLOT_SIZE - 2)
+
+static_assert(RECORD_SIZE(FFT_BINS) <= SLOT_OFS_NEXT, "FFT record must fit in a slot");
+static_assert(FFT_BINS * sizeof(uint32_t) <= ARCHIVE_SLOT_SIZE, "Energy prefix must fit in a slot");
+static_assert(sizeof(SpectrumPyramid) <= ARCHIVE_SLOT_SIZE, "Pyramid must fit in a slot");
+
+////////////////////////////////////////////////////////////////////////////
+// Archive segment constructor. Call format() or attach() before use.
+////////////////////////////////////////////////////////////////////////////
+ArchiveSegment::ArchiveSegment() {
+  _memory = 0;
+  _header = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Initializes an empty segment. The memory should be 4 byte aligned, as
+// it is when it comes from mmap or malloc.
+////////////////////////////////////////////////////////////////////////////
+// memory - segment storage
+// size - size of memory in bytes, at least ARCHIVE_HEADER_SLOTS + 1 slots
+// flags - ARCHIVE_PREFIX and/or ARCHIVE_PYRAMID to store with each record
+////////////////////////////////////////////////////////////////////////////
+int ArchiveSegment::format(uint8_t *memory, uint32_t size, uint8_t flags) {
+  uint32_t slots = size / ARCHIVE_SLOT_SIZE;
+  if (slots < ARCHIVE_HEADER_SLOTS + 1)
+    return 0;
+  if (slots > ARCHIVE_NONE)
+    slots = ARCHIVE_NONE;
+  memset(memory, 0, ARCHIVE_HEADER_SLOTS * ARCHIVE_SLOT_SIZE);
+  _memory = memory;
+  _header = (ArchiveHeader *)memory;
+  _header->version = ARCHIVE_VERSION;
+  _header->slotCount = (uint16_t)slots;
+  _header->used = ARCHIVE_HEADER_SLOTS;
+  _header->sensorCount = 0;
+  _header->flags = flags;
+  _header->magic = ARCHIVE_MAGIC; // Written last so a torn format is not attachable
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Attaches to an existing segment. Headers whose counts do not fit the
+// segment are rejected, so readers can trust them as bounds.
+////////////////////////////////////////////////////////////////////////////
+// memory - segment storage
+// size - size of memory in bytes
+////////////////////////////////////////////////////////////////////////////
+int ArchiveSegment::attach(uint8_t *memory, uint32_t size) {
+  ArchiveHeader *header = (ArchiveHeader *)memory;
+  if (size < ARCHIVE_HEADER_SLOTS * ARCHIVE_SLOT_SIZE || header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION)
+    return 0;
+  if ((uint32_t)header->slotCount * ARCHIVE_SLOT_SIZE > size || header->used > header->slotCount)
+    return 0;
+  if (header->used < ARCHIVE_HEADER_SLOTS || header->sensorCount > ARCHIVE_MAX_SENSORS)
+    return 0;
+  _memory = memory;
+  _header = header;
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the number of slots taken by each record: the record itself,
+// then the optional X/Y prefix slots, then the optional pyramid slot.
+////////////////////////////////////////////////////////////////////////////
+uint8_t ArchiveSegment::stride() const {
+  uint8_t slots = 1;
+  if (_header->flags & ARCHIVE_PREFIX)
+    slots += 2;
+  if (_header->flags & ARCHIVE_PYRAMID)
+    slots += 1;
+  return slots;
+}
+
+bool ArchiveSegment::full() const {
+  return _header == 0 || (uint32_t)_header->used + stride() > _header->slotCount;
+}
+
+uint16_t ArchiveSegment::records() const {
+  return _header ? (_header->used - ARCHIVE_HEADER_SLOTS) / stride() : 0;
+}
+
+const ArchiveSensorIndex *ArchiveSegment::findSensor(uint8_t page) const {
+  for (uint8_t i = 0; i < _header->sensorCount; i++) {
+    if (_header->sensors[i].page == page)
+      return &_header->sensors[i];
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Appends a record to the next free slot and links it to the previous
+// record of the same sensor. With ARCHIVE_PREFIX the energy prefixes are
+// computed once here, at ingest. The slots and link are written before
+// the used count, so readers never see a partly written record.
+////////////////////////////////////////////////////////////////////////////
+// record - binary record (see ADIS16000Record.h)
+// length - record length in bytes
+////////////////////////////////////////////////////////////////////////////
+int ArchiveSegment::append(const uint8_t *record, uint16_t length) {
+  RecordView view(record, length);
+  if (full() || !view.valid() || view.size() > SLOT_OFS_NEXT)
+    return 0;
+
+  ArchiveSensorIndex *sensor = (ArchiveSensorIndex *)findSensor(view.page());
+  if (sensor == 0) {
+    if (_header->sensorCount >= ARCHIVE_MAX_SENSORS)
+      return 0;
+    sensor = &_header->sensors[_header->sensorCount];
+    sensor->page = view.page();
+    sensor->firstSlot = ARCHIVE_NONE;
+    sensor->lastSlot = ARCHIVE_NONE;
+    sensor->slots = 0;
+    sensor->minTime = 0xFFFFFFFFUL;
+    sensor->maxTime = 0;
+    sensor->skipCount = 0;
+    sensor->skipStride = 1;
+    _header->sensorCount++;
+  }
+
+  uint16_t slot = _header->used;
+  uint8_t *data = slotData(slot);
+  memcpy(data, record, view.size());
+  putLE16(data + SLOT_OFS_NEXT, ARCHIVE_NONE);
+  putLE16(data + SLOT_OFS_LENGTH, view.size());
+  if (_header->flags & ARCHIVE_PREFIX) {
+    uint32_t *xPrefix = (uint32_t *)slotData(slot + 1);
+    uint32_t *yPrefix = (uint32_t *)slotData(slot + 2);
+    uint32_t xSum = 0;
+    uint32_t ySum = 0;
+    for (uint16_t i = 0; i < FFT_BINS; i++) {
+      int32_t xData = i < view.count() ? view.x(i) : 0;
+      int32_t yData = i < view.count() ? view.y(i) : 0;
+      xSum += ((uint32_t)(xData * xData)) >> 8;
+      ySum += ((uint32_t)(yData * yData)) >> 8;
+      xPrefix[i] = xSum;
+      yPrefix[i] = ySum;
+    }
+  }
+  if (_header->flags & ARCHIVE_PYRAMID)
+    buildPyramid(view, *(SpectrumPyramid *)slotData(slot + stride() - 1));
+  if (sensor->lastSlot != ARCHIVE_NONE)
+    putLE16(slotData(sensor->lastSlot) + SLOT_OFS_NEXT, slot);
+  else
+    sensor->firstSlot = slot;
+  sensor->lastSlot = slot;
+  uint32_t time = view.timestamp();
+  if (sensor->slots % sensor->skipStride == 0) {
+    if (sensor->skipCount == ARCHIVE_SKIP_ENTRIES) {
+      for (uint8_t i = 0; i < ARCHIVE_SKIP_ENTRIES / 2; i++)
+        sensor->skip[i] = sensor->skip[2 * i];
+      sensor->skipCount = ARCHIVE_SKIP_ENTRIES / 2;
+      sensor->skipStride *= 2;
+    }
+    if (sensor->slots % sensor->skipStride == 0) {
+      sensor->skip[sensor->skipCount].time = time;
+      sensor->skip[sensor->skipCount].slot = slot;
+      sensor->skipCount++;
+    }
+  }
+  sensor->slots++;
+  if (time < sensor->minTime)
+    sensor->minTime = time;
+  if (time > sensor->maxTime)
+    sensor->maxTime = time;
+  _header->used = slot + stride();
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Checks the sparse index, so whole segments can be skipped in a range
+// scan without touching their record slots.
+////////////////////////////////////////////////////////////////////////////
+// page - sensor page
+// from, to - TIME_STMP range, inclusive
+////////////////////////////////////////////////////////////////////////////
+bool ArchiveSegment::overlaps(uint8_t page, uint32_t from, uint32_t to) const {
+  if (_header == 0)
+    return false;
+  const ArchiveSensorIndex *sensor = findSensor(page);
+  return sensor != 0 && sensor->slots != 0 && sensor->minTime <= to && sensor->maxTime >= from;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Finds where a range scan starts. The sensor's skip entries in the header
+// give the last indexed record before from, and the links are followed
+// from there, so at most skipStride record slots are touched. The walk
+// stops at a corrupt or partly written slot.
+////////////////////////////////////////////////////////////////////////////
+// page - sensor page
+// from - earliest TIME_STMP wanted
+// return - slot, or ARCHIVE_NONE
+////////////////////////////////////////////////////////////////////////////
+uint16_t ArchiveSegment::first(uint8_t page, uint32_t from) const {
+  if (!overlaps(page, from, 0xFFFFFFFFUL))
+    return ARCHIVE_NONE;
+  const ArchiveSensorIndex *sensor = findSensor(page);
+  uint16_t slot = sensor->firstSlot;
+  for (uint8_t i = 1; i < sensor->skipCount && i < ARCHIVE_SKIP_ENTRIES && sensor->skip[i].time < from; i++)
+    slot = sensor->skip[i].slot;
+  while (slot != ARCHIVE_NONE) {
+    RecordView record = view(slot);
+    if (!record.valid())
+      return ARCHIVE_NONE;
+    if (record.timestamp() >= from)
+      return slot;
+    slot = next(slot);
+  }
+  return ARCHIVE_NONE;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Follows the link of a record slot. Records are appended in slot order,
+// so a link must point forward; one that does not, or that leads to an
+// invalid record, ends the chain rather than loop or fault.
+////////////////////////////////////////////////////////////////////////////
+uint16_t ArchiveSegment::next(uint16_t slot) const {
+  if (_header == 0 || slot < ARCHIVE_HEADER_SLOTS || slot >= _header->used)
+    return ARCHIVE_NONE;
+  uint16_t nextSlot = getLE16(slotData(slot) + SLOT_OFS_NEXT);
+  if (nextSlot <= slot || nextSlot >= _header->used || !view(nextSlot).valid())
+    return ARCHIVE_NONE;
+  return nextSlot;
+}
+
+RecordView ArchiveSegment::view(uint16_t slot) const {
+  if (_header == 0 || slot < ARCHIVE_HEADER_SLOTS || slot >= _header->used)
+    return RecordView(0, 0);
+  uint8_t *data = slotData(slot);
+  uint16_t length = getLE16(data + SLOT_OFS_LENGTH);
+  if (length > SLOT_OFS_NEXT)
+    return RecordView(0, 0);
+  return RecordView(data, length);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the stored energy prefix of one axis, pointing into the segment.
+////////////////////////////////////////////////////////////////////////////
+// slot - record slot
+// axis - 0 for X, 1 for Y
+////////////////////////////////////////////////////////////////////////////
+const uint32_t *ArchiveSegment::prefix(uint16_t slot, uint8_t axis) const {
+  if (_header == 0 || !(_header->flags & ARCHIVE_PREFIX) || axis > 1 || slot < ARCHIVE_HEADER_SLOTS || slot >= _header->used)
+    return 0;
+  return (const uint32_t *)slotData(slot + 1 + axis);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the energy of a band in two lookups, without reading the
+// record itself. Returns 0 when the segment has no prefixes.
+////////////////////////////////////////////////////////////////////////////
+// slot - record slot
+// axis - 0 for X, 1 for Y
+// firstBin, lastBin - band edges in bins, inclusive (0 - 255)
+////////////////////////////////////////////////////////////////////////////
+uint32_t ArchiveSegment::bandEnergy(uint16_t slot, uint8_t axis, uint16_t firstBin, uint16_t lastBin) const {
+  const uint32_t *energy = prefix(slot, axis);
+  if (energy == 0 || lastBin >= FFT_BINS)
+    return 0;
+  return ::bandEnergy(energy, firstBin, lastBin);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the stored pyramid of a record, pointing into the segment.
+////////////////////////////////////////////////////////////////////////////
+// slot - record slot
+////////////////////////////////////////////////////////////////////////////
+const SpectrumPyramid *ArchiveSegment::pyramid(uint16_t slot) const {
+  if (_header == 0 || !(_header->flags & ARCHIVE_PYRAMID) || slot < ARCHIVE_HEADER_SLOTS || slot >= _header->used)
+    return 0;
+  return (const SpectrumPyramid *)slotData(slot + stride() - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Builds the 64 and 16 bin max-pooled levels of both axes of a record.
+// Bins missing from a short record count as 0.
+////////////////////////////////////////////////////////////////////////////
+// record - FFT record
+// pyramid - receives the levels
+////////////////////////////////////////////////////////////////////////////
+void buildPyramid(const RecordView &record, SpectrumPyramid &pyramid) {
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    for (uint16_t i = 0; i < PYRAMID_L1_BINS; i++) {
+      int16_t peak = 0;
+      for (uint16_t j = i * 4; j < i * 4 + 4 && j < record.count(); j++) {
+        int16_t value = axis ? record.y(j) : record.x(j);
+        if (value > peak)
+          peak = value;
+      }
+      pyramid.level1[axis][i] = peak;
+    }
+    maxPool(pyramid.level1[axis], PYRAMID_L1_BINS, 4, pyramid.level2[axis]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Time rollup constructor. The first record opens the first window.
+////////////////////////////////////////////////////////////////////////////
+// windowLength - window length in TIME_STMP units
+////////////////////////////////////////////////////////////////////////////
+SpectrumRollup::SpectrumRollup(uint32_t windowLength) {
+  _length = windowLength ? windowLength : 1;
+  _window.start = 0;
+  _window.count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Closes the current window when timestamp falls outside it and opens
+// the window containing timestamp. Windows are aligned to multiples of
+// the window length. Returns 1 when a non-empty window was closed.
+////////////////////////////////////////////////////////////////////////////
+int SpectrumRollup::roll(uint32_t timestamp, RollupWindow *closed) {
+  uint32_t start = timestamp - (timestamp % _length);
+  if (_window.count != 0 && start == _window.start)
+    return 0;
+  int done = 0;
+  if (_window.count != 0) {
+    if (closed)
+      memcpy(closed, &_window, sizeof(RollupWindow));
+    done = 1;
+  }
+  _window.start = start;
+  _window.count = 0;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    for (uint8_t i = 0; i < ROLLUP_BINS; i++) {
+      _window.minimum[axis][i] = 0x7FFF;
+      _window.maximum[axis][i] = 0;
+      _window.sum[axis][i] = 0;
+    }
+  }
+  return done;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Adds one record. Sums are 32 bits, so a window holds at least 131072
+// records of full scale bins (a day at one record per second).
+////////////////////////////////////////////////////////////////////////////
+// timestamp - record TIME_STMP
+// pyramid - record pyramid
+// closed - receives the finished window, may be 0
+////////////////////////////////////////////////////////////////////////////
+int SpectrumRollup::add(uint32_t timestamp, const SpectrumPyramid &pyramid, RollupWindow *closed) {
+  int done = roll(timestamp, closed);
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    for (uint8_t i = 0; i < ROLLUP_BINS; i++) {
+      int16_t value = pyramid.level1[axis][i];
+      if (value < _window.minimum[axis][i])
+        _window.minimum[axis][i] = value;
+      if (value > _window.maximum[axis][i])
+        _window.maximum[axis][i] = value;
+      _window.sum[axis][i] += (uint16_t)value;
+    }
+  }
+  _window.count++;
+  return done;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Merges a finished window of a shorter rollup.
+////////////////////////////////////////////////////////////////////////////
+// window - finished window, e.g. from an hourly rollup
+// closed - receives the finished window, may be 0
+////////////////////////////////////////////////////////////////////////////
+int SpectrumRollup::merge(const RollupWindow &window, RollupWindow *closed) {
+  if (window.count == 0)
+    return 0;
+  int done = roll(window.start, closed);
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    for (uint8_t i = 0; i < ROLLUP_BINS; i++) {
+      if (window.minimum[axis][i] < _window.minimum[axis][i])
+        _window.minimum[axis][i] = window.minimum[axis][i];
+      if (window.maximum[axis][i] > _window.maximum[axis][i])
+        _window.maximum[axis][i] = window.maximum[axis][i];
+      _window.sum[axis][i] += window.sum[axis][i];
+    }
+  }
+  _window.count += window.count;
+  return done;
+}
+
+int16_t SpectrumRollup::mean(uint8_t axis, uint8_t bin) const {
+  if (_window.count == 0)
+    return 0;
+  return (int16_t)(_window.sum[axis][bin] / _window.count);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Quantile sketch constructor. The sketch starts empty.
+////////////////////////////////////////////////////////////////////////////
+BinQuantileSketch::BinQuantileSketch() {
+  reset();
+}
+
+void BinQuantileSketch::reset() {
+  memset(_counts, 0, sizeof(_counts));
+  _total = 0;
+}
+
+void BinQuantileSketch::add(int16_t sensorData) {
+  _counts[log8Encode(sensorData) >> 2]++;
+  _total++;
+}
+
+void BinQuantileSketch::merge(const BinQuantileSketch &other) {
+  for (uint8_t i = 0; i < SKETCH_BUCKETS; i++)
+    _counts[i] += other._counts[i];
+  _total += other._total;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the amplitude at a rank, as the middle code of the bucket the
+// rank falls in.
+////////////////////////////////////////////////////////////////////////////
+// permille - rank in 1/1000 (0 = minimum, 1000 = maximum)
+////////////////////////////////////////////////////////////////////////////
+int16_t BinQuantileSketch::quantile(uint16_t permille) const {
+  if (_total == 0)
+    return 0;
+  if (permille > 1000)
+    permille = 1000;
+  uint32_t rank = (uint32_t)(((uint64_t)(_total - 1) * permille) / 1000);
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < SKETCH_BUCKETS; i++) {
+    seen += _counts[i];
+    if (seen > rank)
+      return log8Decode((i << 2) | 2);
+  }
+  return log8Decode(0xFF);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Updates the per-bin sketches of one sensor with a record.
+////////////////////////////////////////////////////////////////////////////
+// record - FFT record
+// sketches - 2 * FFT_BINS sketches, X bins then Y bins
+////////////////////////////////////////////////////////////////////////////
+void sketchRecord(const RecordView &record, BinQuantileSketch *sketches) {
+  uint16_t count = record.count() < FFT_BINS ? record.count() : FFT_BINS;
+  for (uint16_t i = 0; i < count; i++) {
+    sketches[i].add(record.x(i));
+    sketches[FFT_BINS + i].add(record.y(i));
+  }
+}
@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Archive.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Append-only spectrum archive built from fixed-size segments of binary records. A segment is a
+//  plain memory region (on a Linux host, typically an mmap of a segment file), so records are read
+//  back as views into that memory without parsing or copying.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_ARCHIVE_H
+#define ADIS16000_ARCHIVE_H
+
+#include "Arduino.h"
+#include "ADIS16000Spectrum.h"
+#include "ADIS16000Record.h"
+#include "ADIS16000Codec.h"
+
+// Segment layout. The first ARCHIVE_HEADER_SLOTS slots hold the segment
+// header and sensor index; records use the remaining slots. A slot fits
+// one FFT record plus a small trailer.
+#define ARCHIVE_MAGIC		0x53363141UL	// "A16S"
+#define ARCHIVE_VERSION		2
+#define ARCHIVE_SLOT_SIZE	1088
+#define ARCHIVE_MAX_SENSORS	64
+#define ARCHIVE_NONE		0xFFFF
+
+// Segment flags. With ARCHIVE_PREFIX each record is followed by two slots
+// holding the X and Y energy prefixes (see energyPrefix).
+#define ARCHIVE_PREFIX		0x01
+
+// With ARCHIVE_PYRAMID each record is also followed by a slot holding its
+// SpectrumPyramid, so trend views never read full records.
+#define ARCHIVE_PYRAMID		0x02
+
+// Quantile sketch buckets: four log8 codes each
+#define SKETCH_BUCKETS		64
+
+// Pyramid level kept by time rollups
+#define ROLLUP_BINS			PYRAMID_L1_BINS
+
+// Skip entries kept per sensor. Each entry marks every skipStride-th
+// record; when they run out the stride doubles and every other entry is
+// dropped, so a range scan starts at most skipStride records early.
+#define ARCHIVE_SKIP_ENTRIES	16
+
+// Timestamp and slot of one indexed record
+struct ArchiveSkipEntry {
+	uint32_t time;
+	uint16_t slot;
+	uint16_t reserved;
+};
+
+// Sparse index entry: where one sensor's records sit in a segment
+struct ArchiveSensorIndex {
+	uint8_t page;
+	uint8_t skipCount;
+	uint16_t firstSlot;
+	uint16_t lastSlot;
+	uint16_t slots;
+	uint32_t minTime;
+	uint32_t maxTime;
+	uint16_t skipStride;
+	uint16_t reserved;
+	ArchiveSkipEntry skip[ARCHIVE_SKIP_ENTRIES];
+};
+
+// Segment header, stored in the first ARCHIVE_HEADER_SLOTS slots
+struct ArchiveHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t slotCount;
+	uint16_t used;
+	uint8_t sensorCount;
+	uint8_t flags;
+	uint8_t reserved[4];
+	ArchiveSensorIndex sensors[ARCHIVE_MAX_SENSORS];
+};
+
+// Slots taken by the segment header
+#define ARCHIVE_HEADER_SLOTS	((sizeof(ArchiveHeader) + ARCHIVE_SLOT_SIZE - 1) / ARCHIVE_SLOT_SIZE)
+
+// Min/mean/max of each level 1 bin over a time window
+struct RollupWindow {
+	uint32_t start;
+	uint32_t count;
+	int16_t minimum[2][ROLLUP_BINS];
+	int16_t maximum[2][ROLLUP_BINS];
+	uint32_t sum[2][ROLLUP_BINS];
+};
+
+// One archive segment over caller-provided memory
+class ArchiveSegment {
+
+public:
+	ArchiveSegment();
+
+	// Initializes an empty segment in memory (ARCHIVE_HEADER_SLOTS plus record slots). Returns 1 when complete, 0 if size is too small.
+	int format(uint8_t *memory, uint32_t size, uint8_t flags = 0);
+
+	// Attaches to a segment previously formatted in memory. Returns 1 when complete, 0 if it is not a valid segment.
+	int attach(uint8_t *memory, uint32_t size);
+
+	// Appends one binary record. Returns 1 when complete, 0 when full or the record is invalid.
+	int append(const uint8_t *record, uint16_t length);
+
+	// True when no slots are left.
+	bool full() const;
+
+	// True when the segment may hold records of page between from and to (inclusive).
+	bool overlaps(uint8_t page, uint32_t from, uint32_t to) const;
+
+	// First slot of page with timestamp >= from, or ARCHIVE_NONE.
+	uint16_t first(uint8_t page, uint32_t from) const;
+
+	// Next slot of the same sensor, or ARCHIVE_NONE at the end of the chain or a corrupt slot.
+	uint16_t next(uint16_t slot) const;
+
+	// Zero-copy view of the record in slot. Check valid() before reading it.
+	RecordView view(uint16_t slot) const;
+
+	// Energy prefix of axis 0 (X) or 1 (Y) for the record in slot, or 0 without ARCHIVE_PREFIX.
+	const uint32_t *prefix(uint16_t slot, uint8_t axis) const;
+
+	// Energy of bins firstBin..lastBin of one axis, from the stored prefix. Returns sum of squared bins / 256.
+	uint32_t bandEnergy(uint16_t slot, uint8_t axis, uint16_t firstBin, uint16_t lastBin) const;
+
+	// Pyramid of the record in slot, or 0 without ARCHIVE_PYRAMID.
+	const SpectrumPyramid *pyramid(uint16_t slot) const;
+
+	// Number of records stored.
+	uint16_t records() const;
+
+private:
+	const ArchiveSensorIndex *findSensor(uint8_t page) const;
+	uint8_t stride() const;
+	uint8_t *slotData(uint16_t slot) const { return _memory + (uint32_t)slot * ARCHIVE_SLOT_SIZE; }
+
+	uint8_t *_memory;
+	ArchiveHeader *_header;
+
+};
+
+// Incremental time rollup of one sensor (e.g. one instance hourly, one daily)
+class SpectrumRollup {
+
+public:
+	// windowLength is in TIME_STMP units
+	SpectrumRollup(uint32_t windowLength);
+
+	// Adds one record's pyramid. Returns 1 and copies the finished window to closed when the record starts a new window.
+	int add(uint32_t timestamp, const SpectrumPyramid &pyramid, RollupWindow *closed);
+
+	// Merges a finished shorter window (e.g. hourly into daily). Returns 1 when a window was closed, as add().
+	int merge(const RollupWindow &window, RollupWindow *closed);
+
+	// Window being accumulated.
+	const RollupWindow &current() const { return _window; }
+
+	// Mean of one bin of the current window.
+	int16_t mean(uint8_t axis, uint8_t bin) const;
+
+private:
+	int roll(uint32_t timestamp, RollupWindow *closed);
+
+	uint32_t _length;
+	RollupWindow _window;
+
+};
+
+// Fixed-size mergeable quantile sketch of one bin's amplitude over time.
+// A histogram over log8 code buckets: quantiles are within half a bucket
+// (about 7% above 32 LSB, 2 LSB below) and merging is adding counts.
+class BinQuantileSketch {
+
+public:
+	BinQuantileSketch();
+
+	// Clears the sketch.
+	void reset();
+
+	// Adds one amplitude.
+	void add(int16_t sensorData);
+
+	// Adds all values seen by another sketch (other sensors or time windows).
+	void merge(const BinQuantileSketch &other);
+
+	// Amplitude at permille (500 = p50, 990 = p99). Returns 0 when empty.
+	int16_t quantile(uint16_t permille) const;
+
+	// Number of values added.
+	uint32_t total() const { return _total; }
+
+private:
+	uint32_t _counts[SKETCH_BUCKETS];
+	uint32_t _total;
+
+};
+
+// Adds every X and Y bin of a record to 2 * 256 sketches (X bins first).
+void sketchRecord(const RecordView &record, BinQuantileSketch *sketches);
+
+// Builds the pyramid of a record.
+void buildPyramid(const RecordView &record, SpectrumPyramid &pyramid);
+
+#endif
@@ -0,0 +1,322 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Codec.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Spectrum codecs for storing and sending ADIS16229 records in fewer bytes. Each codec works on
+//  caller-provided buffers and needs no allocation, so encoding can run on the gateway between reads.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Codec.h"
+#include "ADIS16000Spectrum.h"
+#include "ADIS16000Record.h"
+
+// Log8 decode table. Codes 0 - 31 are linear, codes 32 - 255 are
+// 32 * r^(code - 32) with r = (32767 / 32)^(1 / 223), rounded.
+static const uint16_t log8Table[256] PROGMEM = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11,
+  12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+  24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
+  36, 37, 39, 40, 41, 42, 44, 45, 46, 48, 49, 51,
+  53, 54, 56, 58, 60, 61, 63, 65, 67, 70, 72, 74,
+  76, 79, 81, 84, 87, 89, 92, 95, 98, 101, 104, 108,
+  111, 114, 118, 122, 126, 130, 134, 138, 142, 147, 151, 156,
+  161, 166, 171, 177, 182, 188, 194, 200, 207, 213, 220, 227,
+  234, 241, 249, 257, 265, 273, 282, 291, 300, 309, 319, 329,
+  340, 350, 361, 373, 385, 397, 409, 422, 436, 449, 464, 478,
+  493, 509, 525, 541, 559, 576, 594, 613, 632, 652, 673, 694,
+  716, 739, 762, 786, 811, 837, 863, 890, 918, 947, 977, 1008,
+  1040, 1073, 1107, 1142, 1178, 1215, 1253, 1293, 1334, 1376, 1419, 1464,
+  1510, 1558, 1607, 1658, 1710, 1764, 1820, 1877, 1937, 1998, 2061, 2126,
+  2193, 2262, 2334, 2407, 2483, 2562, 2642, 2726, 2812, 2901, 2992, 3087,
+  3184, 3285, 3388, 3495, 3606, 3720, 3837, 3958, 4083, 4212, 4345, 4482,
+  4624, 4770, 4920, 5076, 5236, 5401, 5572, 5748, 5929, 6116, 6309, 6509,
+  6714, 6926, 7145, 7370, 7603, 7843, 8091, 8346, 8609, 8881, 9162, 9451,
+  9749, 10057, 10375, 10702, 11040, 11389, 11748, 12119, 12502, 12896, 13303, 13723,
+  14157, 14604, 15065, 15540, 16031, 16537, 17059, 17598, 18153, 18726, 19318, 19927,
+  20557, 21206, 21875, 22566, 23278, 24013, 24771, 25553, 26360, 27192, 28051, 28936,
+  29850, 30792, 31764, 32767
+};
+
+// Log8 encode thresholds. Code n is the number of thresholds <= value,
+// each threshold being the midpoint between two decoded levels.
+static const uint16_t log8Thresholds[255] PROGMEM = {
+  1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+  13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
+  37, 38, 40, 41, 42, 43, 45, 46, 47, 49, 50, 52,
+  54, 55, 57, 59, 61, 62, 64, 66, 69, 71, 73, 75,
+  78, 80, 83, 86, 88, 91, 94, 97, 100, 103, 106, 110,
+  113, 116, 120, 124, 128, 132, 136, 140, 145, 149, 154, 159,
+  164, 169, 174, 180, 185, 191, 197, 204, 210, 217, 224, 231,
+  238, 245, 253, 261, 269, 278, 287, 296, 305, 314, 324, 335,
+  345, 356, 367, 379, 391, 403, 416, 429, 443, 457, 471, 486,
+  501, 517, 533, 550, 568, 585, 604, 623, 642, 663, 684, 705,
+  728, 751, 774, 799, 824, 850, 877, 904, 933, 962, 993, 1024,
+  1057, 1090, 1125, 1160, 1197, 1234, 1273, 1314, 1355, 1398, 1442, 1487,
+  1534, 1583, 1633, 1684, 1737, 1792, 1849, 1907, 1968, 2030, 2094, 2160,
+  2228, 2298, 2371, 2445, 2523, 2602, 2684, 2769, 2857, 2947, 3040, 3136,
+  3235, 3337, 3442, 3551, 3663, 3779, 3898, 4021, 4148, 4279, 4414, 4553,
+  4697, 4845, 4998, 5156, 5319, 5487, 5660, 5839, 6023, 6213, 6409, 6612,
+  6820, 7036, 7258, 7487, 7723, 7967, 8219, 8478, 8745, 9022, 9307, 9600,
+  9903, 10216, 10539, 10871, 11215, 11569, 11934, 12311, 12699, 13100, 13513, 13940,
+  14381, 14835, 15303, 15786, 16284, 16798, 17329, 17876, 18440, 19022, 19623, 20242,
+  20882, 21541, 22221, 22922, 23646, 24392, 25162, 25957, 26776, 27622, 28494, 29393,
+  30321, 31278, 32266
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Delta codec constructor. The codec starts unprimed, so the first record
+// is always a keyframe.
+////////////////////////////////////////////////////////////////////////////
+// previous - state storage for count values
+// count - values per record
+////////////////////////////////////////////////////////////////////////////
+SpectrumDeltaCodec::SpectrumDeltaCodec(int16_t *previous, uint16_t count) {
+  _previous = previous;
+  _count = count;
+  _sequence = 0;
+  reset();
+}
+
+void SpectrumDeltaCodec::reset() {
+  _primed = false;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Encodes a record. Deltas wrap modulo 2^16 so the coding is lossless.
+// Zigzag maps small negative and positive deltas to small codes, which
+// the varint then stores in one byte for deltas within +/-63.
+////////////////////////////////////////////////////////////////////////////
+// values - count raw values
+// out - output buffer, DELTA_MAX_SIZE(count) bytes always suffice
+// outSize - size of out
+// keyframe - code against zero instead of the previous record
+// return - bytes written, 0 when out is too small (state unchanged)
+////////////////////////////////////////////////////////////////////////////
+uint16_t SpectrumDeltaCodec::encode(const int16_t *values, uint8_t *out, uint16_t outSize, bool keyframe) {
+  if (!_primed)
+    keyframe = true;
+  if (outSize < DELTA_HEADER_SIZE)
+    return 0;
+  uint16_t n = 0;
+  out[n++] = keyframe ? DELTA_KEYFRAME : 0;
+  out[n++] = _sequence;
+  for (uint16_t i = 0; i < _count; i++) {
+    int16_t base = keyframe ? 0 : _previous[i];
+    int16_t delta = (int16_t)((uint16_t)values[i] - (uint16_t)base);
+    uint16_t code = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+    while (code >= 0x80) {
+      if (n >= outSize)
+        return 0;
+      out[n++] = (uint8_t)(code | 0x80);
+      code >>= 7;
+    }
+    if (n >= outSize)
+      return 0;
+    out[n++] = (uint8_t)code;
+  }
+  for (uint16_t i = 0; i < _count; i++)
+    _previous[i] = values[i];
+  _primed = true;
+  _sequence++;
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Decodes a record. A delta record received before any keyframe is
+// rejected, and so is one whose sequence number does not follow the last
+// decoded record: a record was lost (a frame dropped for a bad CRC, say),
+// so the decoder unprimes and waits for the next keyframe instead of
+// applying deltas to a stale base. Runs of one byte codes, the common case for steady machines,
+// take a short path without the varint loop.
+////////////////////////////////////////////////////////////////////////////
+// in - encoded record
+// length - bytes available at in
+// values - receives count values
+// return - bytes consumed, 0 on a malformed record (state unchanged) or a gap
+////////////////////////////////////////////////////////////////////////////
+uint16_t SpectrumDeltaCodec::decode(const uint8_t *in, uint16_t length, int16_t *values) {
+  if (length < DELTA_HEADER_SIZE)
+    return 0;
+  bool keyframe = (in[0] & DELTA_KEYFRAME) != 0;
+  if (!keyframe && (!_primed || in[1] != _sequence)) {
+    _primed = false;
+    return 0;
+  }
+  uint16_t n = DELTA_HEADER_SIZE;
+  for (uint16_t i = 0; i < _count; i++) {
+    if (n >= length)
+      return 0;
+    uint16_t code = in[n++];
+    if (code & 0x80) {
+      code &= 0x7F;
+      uint8_t shift = 7;
+      uint8_t data;
+      do {
+        if (n >= length || shift > 14)
+          return 0;
+        data = in[n++];
+        code |= (uint16_t)(data & 0x7F) << shift;
+        shift += 7;
+      } while (data & 0x80);
+    }
+    int16_t delta = (int16_t)((code >> 1) ^ (uint16_t)(-(int16_t)(code & 1)));
+    int16_t base = keyframe ? 0 : _previous[i];
+    values[i] = (int16_t)((uint16_t)base + (uint16_t)delta);
+  }
+  for (uint16_t i = 0; i < _count; i++)
+    _previous[i] = values[i];
+  _primed = true;
+  _sequence = in[1] + 1;
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Encodes one FFT magnitude as a log8 code. Values below LOG8_LINEAR are
+// exact. Above that the decoded value is within 2.7% of the input (1.7%
+// from 256 LSB up), which is below the bin to bin variance of an averaged
+// FFT record. Negative values encode as 0.
+//
+// The code is found with a fixed eight step binary search over the
+// midpoint table, so every value costs the same and there are no data
+// dependent loop exits.
+////////////////////////////////////////////////////////////////////////////
+// sensorData - raw FFT magnitude
+// return - log8 code
+////////////////////////////////////////////////////////////////////////////
+uint8_t log8Encode(int16_t sensorData) {
+  if (sensorData <= 0)
+    return 0;
+  uint16_t value = (uint16_t)sensorData;
+  uint8_t code = 0;
+  for (uint8_t step = 128; step != 0; step >>= 1) {
+    uint8_t probe = code + step;
+    code = (value >= pgm_read_word(&log8Thresholds[probe - 1])) ? probe : code;
+  }
+  return code;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Decodes one log8 code with a single table lookup.
+////////////////////////////////////////////////////////////////////////////
+// code - log8 code
+// return - FFT magnitude
+////////////////////////////////////////////////////////////////////////////
+int16_t log8Decode(uint8_t code) {
+  return (int16_t)pgm_read_word(&log8Table[code]);
+}
+
+void log8EncodeBlock(const int16_t *in, uint8_t *out, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++)
+    out[i] = log8Encode(in[i]);
+}
+
+void log8DecodeBlock(const uint8_t *in, int16_t *out, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++)
+    out[i] = log8Decode(in[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Finds the noise floor of a spectrum as a percentile of its bins. The
+// value is built one bit at a time by counting the bins below each
+// candidate, which gives the exact order statistic without sorting or
+// copying the spectrum. Negative bins count as 0.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins
+// percentile - 0 - 100, 50 is the median
+// return - floor in raw LSB
+////////////////////////////////////////////////////////////////////////////
+int16_t noiseFloor(const int16_t *spectrum, uint16_t bins, uint8_t percentile) {
+  if (bins == 0)
+    return 0;
+  if (percentile > 100)
+    percentile = 100;
+  uint16_t rank = (uint16_t)(((uint32_t)(bins - 1) * percentile) / 100);
+  int16_t level = 0;
+  for (int16_t bit = 0x4000; bit != 0; bit >>= 1) {
+    int16_t candidate = level | bit;
+    uint16_t below = 0;
+    for (uint16_t i = 0; i < bins; i++)
+      below += (spectrum[i] < candidate);
+    if (below <= rank)
+      level = candidate;
+  }
+  return level;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Encodes only the bins standing above the noise floor. Healthy machines
+// leave most bins at the floor, so a record typically shrinks 5-10x.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes, at most 256 bins
+// bins - number of bins
+// percentile - floor percentile, see noiseFloor
+// margin - bins must exceed floor + margin to be kept
+// out - output buffer, SPARSE_HEADER_SIZE + SPARSE_ENTRY_SIZE * bins always suffice
+// outSize - size of out
+// return - bytes written, 0 when out is too small
+////////////////////////////////////////////////////////////////////////////
+uint16_t sparseEncode(const int16_t *spectrum, uint16_t bins, uint8_t percentile, int16_t margin, uint8_t *out, uint16_t outSize) {
+  if (bins > FFT_BINS || outSize < SPARSE_HEADER_SIZE)
+    return 0;
+  int16_t level = noiseFloor(spectrum, bins, percentile);
+  int32_t threshold = (int32_t)level + margin;
+  uint16_t n = SPARSE_HEADER_SIZE;
+  uint16_t count = 0;
+  for (uint16_t i = 0; i < bins; i++) {
+    if (spectrum[i] <= threshold)
+      continue;
+    if (n + SPARSE_ENTRY_SIZE > outSize)
+      return 0;
+    out[n] = (uint8_t)i;
+    putLE16(out + n + 1, (uint16_t)spectrum[i]);
+    n += SPARSE_ENTRY_SIZE;
+    count++;
+  }
+  putLE16(out, (uint16_t)level);
+  putLE16(out + 2, count);
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Rebuilds a dense spectrum: every bin is set to the floor, then the kept
+// bins are scattered back. The fill is a plain store loop the compiler
+// can vectorize on hosts that support it.
+////////////////////////////////////////////////////////////////////////////
+// in - sparse record
+// length - bytes available at in
+// spectrum - receives bins values
+// bins - number of bins
+// return - bytes consumed, 0 on a malformed record
+////////////////////////////////////////////////////////////////////////////
+uint16_t sparseDecode(const uint8_t *in, uint16_t length, int16_t *spectrum, uint16_t bins) {
+  if (length < SPARSE_HEADER_SIZE)
+    return 0;
+  int16_t level = (int16_t)getLE16(in);
+  uint16_t count = getLE16(in + 2);
+  uint32_t size = SPARSE_HEADER_SIZE + (uint32_t)count * SPARSE_ENTRY_SIZE;
+  if (size > length || count > bins)
+    return 0;
+  for (uint16_t i = 0; i < bins; i++)
+    spectrum[i] = level;
+  const uint8_t *p = in + SPARSE_HEADER_SIZE;
+  for (uint16_t i = 0; i < count; i++, p += SPARSE_ENTRY_SIZE) {
+    if (p[0] >= bins)
+      return 0;
+    spectrum[p[0]] = (int16_t)getLE16(p + 1);
+  }
+  return (uint16_t)size;
+}
@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Codec.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Spectrum codecs for storing and sending ADIS16229 records in fewer bytes. Each codec works on
+//  caller-provided buffers and needs no allocation, so encoding can run on the gateway between reads.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_CODEC_H
+#define ADIS16000_CODEC_H
+
+#include "Arduino.h"
+
+// Delta codec frame flags
+#define DELTA_KEYFRAME		0x01
+
+// Record header: flags, then a sequence number that increments per record
+#define DELTA_HEADER_SIZE	2
+
+// Worst case delta codec output for count values
+#define DELTA_MAX_SIZE(count)	(DELTA_HEADER_SIZE + 3 * (uint16_t)(count))
+
+// Per-sensor delta codec. Each record is coded as zigzag varint deltas against the previous
+// record of the same sensor. Encoder and decoder each keep their own copy of the previous record.
+class SpectrumDeltaCodec {
+
+public:
+	// previous holds count values of state (e.g. 512 for interleaved X/Y bins)
+	SpectrumDeltaCodec(int16_t *previous, uint16_t count);
+
+	// Forgets the previous record; the next encode is a keyframe.
+	void reset();
+
+	// Encodes count values. Returns the number of bytes written, 0 when out is too small.
+	uint16_t encode(const int16_t *values, uint8_t *out, uint16_t outSize, bool keyframe);
+
+	// Decodes one encoded record into count values. Returns bytes consumed, 0 on a malformed record or a sequence gap.
+	uint16_t decode(const uint8_t *in, uint16_t length, int16_t *values);
+
+private:
+	int16_t *_previous;
+	uint16_t _count;
+	bool _primed;
+	uint8_t _sequence;
+
+};
+
+// Log8 codes below this value are exact; above it each code is about 3.2% larger than the last
+#define LOG8_LINEAR			32
+
+// Encodes one FFT magnitude to 8 bits. Returns the log8 code.
+uint8_t log8Encode(int16_t sensorData);
+
+// Decodes one log8 code. Returns the FFT magnitude.
+int16_t log8Decode(uint8_t code);
+
+// Encodes / decodes count FFT magnitudes.
+void log8EncodeBlock(const int16_t *in, uint8_t *out, uint16_t count);
+void log8DecodeBlock(const uint8_t *in, int16_t *out, uint16_t count);
+
+// Sparse record layout: floor (int16), entry count (uint16), then entries of bin index (uint8) and value (int16)
+#define SPARSE_HEADER_SIZE	4
+#define SPARSE_ENTRY_SIZE	3
+
+// Noise floor of a spectrum at the given percentile (50 = median). Returns the floor in raw LSB.
+int16_t noiseFloor(const int16_t *spectrum, uint16_t bins, uint8_t percentile);
+
+// Encodes bins above floor + margin as (index, value) pairs. Returns bytes written, 0 when out is too small.
+uint16_t sparseEncode(const int16_t *spectrum, uint16_t bins, uint8_t percentile, int16_t margin, uint8_t *out, uint16_t outSize);
+
+// Rebuilds the dense spectrum from a sparse record. Returns bytes consumed, 0 on a malformed record.
+uint16_t sparseDecode(const uint8_t *in, uint16_t length, int16_t *spectrum, uint16_t bins);
+
+#endif
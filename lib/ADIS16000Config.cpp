@@ -0,0 +1,223 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Config.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Declarative configuration for the ADIS16000 gateway and its ADIS16229 sensors. The desired
+//  settings are flattened into register/value entries, which the driver reconciles against the
+//  registers, writing and saving only what differs. Saves are coalesced over a time window and
+//  skipped when the settings match the last committed snapshot, to spare device flash. Alarm
+//  bands given in Hz and mg are compiled to bin indexes and raw thresholds.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000.h"
+
+// Saved configuration registers, in entry order
+static const uint8_t gatewayRegisters[] = { NETWORK_ID, TX_PWR_CTRL_G };
+static const uint8_t sensorRegisters[] = { TX_PWR_CTRL_S, UPDAT_INT, INT_SCL, REC_CTRL1, REC_CTRL2,
+  FFT_AVG1, FFT_AVG2, ALM_CTRL, ALM_S_MAG };
+
+static void setEntry(ConfigEntry &entry, uint8_t regAddr, uint16_t value) {
+  entry.regAddr = regAddr;
+  entry.value = value;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Flattens a gateway configuration into register entries.
+////////////////////////////////////////////////////////////////////////////
+// config - desired gateway settings
+// entries - CONFIG_MAX_ENTRIES entries
+////////////////////////////////////////////////////////////////////////////
+uint8_t gatewayEntries(const GatewayConfig &config, ConfigEntry *entries) {
+  setEntry(entries[0], gatewayRegisters[0], config.networkId);
+  setEntry(entries[1], gatewayRegisters[1], config.txPower);
+  return sizeof(gatewayRegisters);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Flattens a sensor configuration into register entries on its page.
+////////////////////////////////////////////////////////////////////////////
+// config - desired sensor settings
+// entries - CONFIG_MAX_ENTRIES entries
+////////////////////////////////////////////////////////////////////////////
+uint8_t sensorEntries(const SensorConfig &config, ConfigEntry *entries) {
+  uint16_t values[] = { config.txPower, config.interval, config.scalefactor, config.recCtrl1,
+    config.recCtrl2, config.fftAvg1, config.fftAvg2, config.almCtrl, config.almSMag };
+  for (uint8_t i = 0; i < sizeof(sensorRegisters); i++)
+    setEntry(entries[i], sensorRegisters[i], values[i]);
+  return sizeof(sensorRegisters);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the registers whose values make up the saved configuration of
+// a page, used to snapshot it.
+////////////////////////////////////////////////////////////////////////////
+// page - 0 for the gateway, else a sensor page
+// regAddrs - receives a pointer to the register list
+////////////////////////////////////////////////////////////////////////////
+uint8_t configRegisters(uint8_t page, const uint8_t **regAddrs) {
+  if (page == 0) {
+    *regAddrs = gatewayRegisters;
+    return sizeof(gatewayRegisters);
+  }
+  *regAddrs = sensorRegisters;
+  return sizeof(sensorRegisters);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Converts a frequency to the nearest FFT bin, clamped to the spectrum.
+////////////////////////////////////////////////////////////////////////////
+static uint16_t alarmBin(float hz, float binWidth) {
+  float bin = hz / binWidth + 0.5;
+  if (bin < 0)
+    return 0;
+  return bin > FFT_BINS - 1 ? FFT_BINS - 1 : (uint16_t)bin;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Converts a magnitude in mg to FFT LSBs, clamped to the register range.
+////////////////////////////////////////////////////////////////////////////
+static uint16_t alarmLSB(float mg, uint8_t gRange) {
+  float lsb = mg / (FFT_MG_PER_LSB * gRange) + 0.5;
+  if (lsb < 0)
+    return 0;
+  return lsb > 0x7FFF ? 0x7FFF : (uint16_t)lsb;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Compiles alarm bands to register values at load time. Band edges are
+// rounded to the nearest bin and put in order; thresholds are rounded to
+// LSBs of the FFT scale for the range. For constant tables use
+// ALARM_BIN and ALARM_LSB, which fold at compile time.
+////////////////////////////////////////////////////////////////////////////
+// bands - bands in Hz and mg
+// count - number of bands, at most ALARM_MAX_BANDS are compiled
+// binWidth - FFT bin width in Hz
+// gRange - measurement range in g, as passed to scaleFFT
+// regs - receives the register values
+////////////////////////////////////////////////////////////////////////////
+uint8_t compileAlarmBands(const AlarmBand *bands, uint8_t count, float binWidth, uint8_t gRange, AlarmBandRegs *regs) {
+  if (count > ALARM_MAX_BANDS)
+    count = ALARM_MAX_BANDS;
+  if (binWidth <= 0 || gRange == 0)
+    return 0;
+  for (uint8_t i = 0; i < count; i++) {
+    uint16_t low = alarmBin(bands[i].lowHz, binWidth);
+    uint16_t high = alarmBin(bands[i].highHz, binWidth);
+    regs[i].fLow = low < high ? low : high;
+    regs[i].fHigh = low < high ? high : low;
+    regs[i].xMag1 = alarmLSB(bands[i].xMag1Mg, gRange);
+    regs[i].yMag1 = alarmLSB(bands[i].yMag1Mg, gRange);
+    regs[i].xMag2 = alarmLSB(bands[i].xMag2Mg, gRange);
+    regs[i].yMag2 = alarmLSB(bands[i].yMag2Mg, gRange);
+  }
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Save coalescer constructor.
+////////////////////////////////////////////////////////////////////////////
+// slots - table of capacity entries, one per page that is saved
+// capacity - table size
+// windowMs - time a request waits for more changes, SAVE_WINDOW_MS by default
+////////////////////////////////////////////////////////////////////////////
+SaveCoalescer::SaveCoalescer(SaveSlot *slots, uint8_t capacity, uint16_t windowMs) {
+  _slots = slots;
+  _capacity = capacity;
+  _count = 0;
+  _windowMs = windowMs;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Requests a save. The first request opens the window; requests inside
+// it merge into the same save. The window is not extended by later
+// requests, so a steady stream of tweaks still saves once per window.
+////////////////////////////////////////////////////////////////////////////
+// page - 0 for the gateway, else a sensor page
+// now - current time from millis()
+////////////////////////////////////////////////////////////////////////////
+int SaveCoalescer::request(uint8_t page, uint32_t now) {
+  uint8_t i = 0;
+  while (i < _count && _slots[i].page != page)
+    i++;
+  if (i == _count) {
+    if (_count >= _capacity)
+      return -1;
+    SaveSlot &s = _slots[_count++];
+    s.page = page;
+    s.pending = 0;
+    s.committed = 0;
+    s.snapshot = 0;
+    s.flashCount = 0;
+    s.requests = 0;
+    s.coalesced = 0;
+    s.saves = 0;
+    s.skipped = 0;
+    s.failures = 0;
+  }
+  SaveSlot &s = _slots[i];
+  s.requests++;
+  if (s.pending) {
+    s.coalesced++;
+    return 0;
+  }
+  s.pending = 1;
+  s.due = now + _windowMs;
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the pending slot whose window has passed, oldest first.
+////////////////////////////////////////////////////////////////////////////
+// now - current time from millis()
+////////////////////////////////////////////////////////////////////////////
+int8_t SaveCoalescer::due(uint32_t now) const {
+  int8_t best = SAVE_NONE;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!_slots[i].pending || (int32_t)(now - _slots[i].due) < 0)
+      continue;
+    if (best == SAVE_NONE || (int32_t)(_slots[i].due - _slots[best].due) < 0)
+      best = i;
+  }
+  return best;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Records the outcome of a save. A failed save stays pending and is
+// retried after another window.
+////////////////////////////////////////////////////////////////////////////
+// index - slot returned by due
+// now - current time from millis()
+// result - SAVE_COMMITTED, SAVE_SKIPPED or SAVE_FAILED
+// snapshot - CRC of the settings that were saved
+// flashCount - flash counter read after the save
+////////////////////////////////////////////////////////////////////////////
+int SaveCoalescer::finished(int8_t index, uint32_t now, int result, uint16_t snapshot, uint16_t flashCount) {
+  SaveSlot &s = _slots[index];
+  if (result == SAVE_FAILED) {
+    s.failures++;
+    s.due = now + _windowMs;
+    return 1;
+  }
+  s.pending = 0;
+  if (result == SAVE_SKIPPED) {
+    s.skipped++;
+    return 1;
+  }
+  s.saves++;
+  s.committed = 1;
+  s.snapshot = snapshot;
+  s.flashCount = flashCount;
+  return 1;
+}
@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Config.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Declarative configuration for the ADIS16000 gateway and its ADIS16229 sensors. The desired
+//  settings are flattened into register/value entries, which the driver reconciles against the
+//  registers, writing and saving only what differs. Saves are coalesced over a time window and
+//  skipped when the settings match the last committed snapshot, to spare device flash. Alarm
+//  bands given in Hz and mg are compiled to bin indexes and raw thresholds.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_CONFIG_H
+#define ADIS16000_CONFIG_H
+
+#include "Arduino.h"
+
+// Most entries a configuration flattens to
+#define CONFIG_MAX_ENTRIES	12
+
+// One register and the value it should hold
+struct ConfigEntry {
+	uint8_t regAddr;
+	uint16_t value;
+};
+
+// Desired gateway settings
+struct GatewayConfig {
+	uint16_t networkId;		// NETWORK_ID
+	uint16_t txPower;		// TX_PWR_CTRL_G
+};
+
+// Desired settings of one sensor. Register values are raw; see the datasheet for the bit fields.
+struct SensorConfig {
+	uint8_t page;			// Sensor page (PAGE_ID)
+	uint16_t txPower;		// TX_PWR_CTRL_S
+	uint16_t interval;		// UPDAT_INT
+	uint16_t scalefactor;	// INT_SCL
+	uint16_t recCtrl1;		// REC_CTRL1: record mode, window, range
+	uint16_t recCtrl2;		// REC_CTRL2
+	uint16_t fftAvg1;		// FFT_AVG1: averaging
+	uint16_t fftAvg2;		// FFT_AVG2
+	uint16_t almCtrl;		// ALM_CTRL: alarm enables
+	uint16_t almSMag;		// ALM_S_MAG: system alarm level
+};
+
+// Flattens a gateway configuration. Returns the number of entries written.
+uint8_t gatewayEntries(const GatewayConfig &config, ConfigEntry *entries);
+
+// Flattens a sensor configuration. Returns the number of entries written.
+uint8_t sensorEntries(const SensorConfig &config, ConfigEntry *entries);
+
+// Registers that make up the saved configuration of a page (0 for the gateway). Returns their number.
+uint8_t configRegisters(uint8_t page, const uint8_t **regAddrs);
+
+// Alarm bands per sensor (ALM_PNTR values 0 to ALARM_MAX_BANDS - 1)
+#define ALARM_MAX_BANDS		6
+
+// FFT magnitude scale in mg per LSB for each g of range (0.0153 mg/LSB at 1 g, 0.3052 at 20 g)
+#define FFT_MG_PER_LSB		0.0152588
+
+// Compile-time conversions for constant band tables. binWidth is the FFT bin width in Hz.
+#define ALARM_BIN(hz, binWidth)		((uint16_t)((hz) / (binWidth) + 0.5))
+#define ALARM_LSB(mg, gRange)		((uint16_t)((mg) / (FFT_MG_PER_LSB * (gRange)) + 0.5))
+
+// Alarm band in engineering units
+struct AlarmBand {
+	float lowHz;
+	float highHz;
+	float xMag1Mg;		// ALM_X_MAG1 level
+	float yMag1Mg;		// ALM_Y_MAG1 level
+	float xMag2Mg;		// ALM_X_MAG2 level
+	float yMag2Mg;		// ALM_Y_MAG2 level
+};
+
+// Alarm band as written to the ALM_ registers
+struct AlarmBandRegs {
+	uint16_t fLow;		// ALM_F_LOW bin
+	uint16_t fHigh;		// ALM_F_HIGH bin
+	uint16_t xMag1;
+	uint16_t yMag1;
+	uint16_t xMag2;
+	uint16_t yMag2;
+};
+
+// Converts bands for a bin width (Hz) and range (g). Returns the number of bands compiled.
+uint8_t compileAlarmBands(const AlarmBand *bands, uint8_t count, float binWidth, uint8_t gRange, AlarmBandRegs *regs);
+
+// Default time a save request waits for more changes before it is committed
+#define SAVE_WINDOW_MS		2000
+
+// No save due
+#define SAVE_NONE			-1
+
+// Results passed to SaveCoalescer::finished
+#define SAVE_FAILED			-1
+#define SAVE_SKIPPED		0
+#define SAVE_COMMITTED		1
+
+// Save state and flash metrics of one page
+struct SaveSlot {
+	uint8_t page;
+	uint8_t pending;
+	uint8_t committed;		// snapshot holds the last committed settings
+	uint32_t due;
+	uint16_t snapshot;		// CRC of the configRegisters values and alarm bands at the last save
+	uint16_t flashCount;	// FLASH_CNT_G / FLASH_CNT_S after the last save
+	uint32_t requests;
+	uint32_t coalesced;		// Requests merged into a save already pending
+	uint32_t saves;
+	uint32_t skipped;		// Saves dropped because the settings matched the snapshot
+	uint32_t failures;
+};
+
+// Defers and merges save requests per page over a caller-provided table.
+// The driver commits due saves with ADIS16000::flushSaves.
+class SaveCoalescer {
+
+public:
+	SaveCoalescer(SaveSlot *slots, uint8_t capacity, uint16_t windowMs);
+
+	// Requests a save of page. Returns 1 if a save was scheduled, 0 if merged into a pending one, -1 if the table is full.
+	int request(uint8_t page, uint32_t now);
+
+	// Slot whose save window has passed. Returns its index or SAVE_NONE.
+	int8_t due(uint32_t now) const;
+
+	// Records the outcome of a due save (SAVE_COMMITTED, SAVE_SKIPPED or SAVE_FAILED). Returns 1 when complete.
+	int finished(int8_t index, uint32_t now, int result, uint16_t snapshot, uint16_t flashCount);
+
+	// Slot table entry.
+	SaveSlot &slot(int8_t index) { return _slots[index]; }
+
+	// Number of pages tracked.
+	uint8_t count() const { return _count; }
+
+private:
+	SaveSlot *_slots;
+	uint8_t _capacity;
+	uint8_t _count;
+	uint16_t _windowMs;
+
+};
+
+#endif
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Record.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Compact little-endian binary record format for ADIS16229 spectra and captures. A record is a
+//  fixed 18 byte header followed by interleaved X/Y int16 pairs in readout order, so it can be
+//  filled while the buffer is read and sent without reformatting.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Record.h"
+
+static void putLE32(uint8_t *p, uint32_t value) {
+  putLE16(p, (uint16_t)value);
+  putLE16(p + 2, (uint16_t)(value >> 16));
+}
+
+static uint32_t getLE32(const uint8_t *p) {
+  return (uint32_t)getLE16(p) | ((uint32_t)getLE16(p + 2) << 16);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Writes a record header.
+////////////////////////////////////////////////////////////////////////////
+// record - record buffer of at least RECORD_SIZE(header.count) bytes
+// header - header fields
+////////////////////////////////////////////////////////////////////////////
+void writeRecordHeader(uint8_t *record, const RecordHeader &header) {
+  record[RECORD_OFS_VERSION] = RECORD_VERSION;
+  record[RECORD_OFS_PAGE] = header.page;
+  putLE32(record + RECORD_OFS_TIME, header.timestamp);
+  record[RECORD_OFS_RANGE] = header.range;
+  record[RECORD_OFS_FLAGS] = header.flags;
+  putLE16(record + RECORD_OFS_AVG_CNT, header.avgCnt);
+  putLE16(record + RECORD_OFS_TEMP, (uint16_t)header.temperature);
+  putLE16(record + RECORD_OFS_SUPPLY, (uint16_t)header.supply);
+  putLE16(record + RECORD_OFS_RSSI, (uint16_t)header.rssi);
+  putLE16(record + RECORD_OFS_COUNT, header.count);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Writes one X/Y pair directly into the record.
+////////////////////////////////////////////////////////////////////////////
+// record - record buffer
+// n - pair index (bin or sample)
+// xData, yData - raw register values
+////////////////////////////////////////////////////////////////////////////
+void writeRecordPair(uint8_t *record, uint16_t n, int16_t xData, int16_t yData) {
+  uint8_t *p = record + RECORD_HEADER_SIZE + 4 * n;
+  putLE16(p, (uint16_t)xData);
+  putLE16(p + 2, (uint16_t)yData);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Record view constructor. The buffer must outlive the view.
+////////////////////////////////////////////////////////////////////////////
+// data - record bytes
+// length - number of valid bytes at data
+////////////////////////////////////////////////////////////////////////////
+RecordView::RecordView(const uint8_t *data, uint16_t length) {
+  _data = data;
+  _length = length;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns true when the buffer holds a complete record of a known version.
+////////////////////////////////////////////////////////////////////////////
+bool RecordView::valid() const {
+  if (_data == 0 || _length < RECORD_HEADER_SIZE)
+    return false;
+  if (_data[RECORD_OFS_VERSION] != RECORD_VERSION)
+    return false;
+  return (uint32_t)RECORD_HEADER_SIZE + 4UL * count() <= _length;
+}
+
+uint32_t RecordView::timestamp() const {
+  return getLE32(_data + RECORD_OFS_TIME);
+}
+
+uint16_t RecordView::avgCnt() const {
+  return getLE16(_data + RECORD_OFS_AVG_CNT);
+}
+
+int16_t RecordView::temperature() const {
+  return (int16_t)getLE16(_data + RECORD_OFS_TEMP);
+}
+
+int16_t RecordView::supply() const {
+  return (int16_t)getLE16(_data + RECORD_OFS_SUPPLY);
+}
+
+int16_t RecordView::rssi() const {
+  return (int16_t)getLE16(_data + RECORD_OFS_RSSI);
+}
+
+uint16_t RecordView::count() const {
+  return getLE16(_data + RECORD_OFS_COUNT);
+}
+
+int16_t RecordView::x(uint16_t n) const {
+  return (int16_t)getLE16(_data + RECORD_HEADER_SIZE + 4 * n);
+}
+
+int16_t RecordView::y(uint16_t n) const {
+  return (int16_t)getLE16(_data + RECORD_HEADER_SIZE + 4 * n + 2);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Decodes all header fields.
+////////////////////////////////////////////////////////////////////////////
+// header - receives the header fields
+////////////////////////////////////////////////////////////////////////////
+void RecordView::header(RecordHeader &header) const {
+  header.page = page();
+  header.timestamp = timestamp();
+  header.range = range();
+  header.flags = flags();
+  header.avgCnt = avgCnt();
+  header.temperature = temperature();
+  header.supply = supply();
+  header.rssi = rssi();
+  header.count = count();
+}
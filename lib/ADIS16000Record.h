@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Record.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Compact little-endian binary record format for ADIS16229 spectra and captures. A record is a
+//  fixed 18 byte header followed by interleaved X/Y int16 pairs in readout order, so it can be
+//  filled while the buffer is read and sent without reformatting.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_RECORD_H
+#define ADIS16000_RECORD_H
+
+#include "Arduino.h"
+
+// Record layout version
+#define RECORD_VERSION		1
+
+// Record header layout (byte offsets, all fields little-endian)
+#define RECORD_HEADER_SIZE	18
+#define RECORD_OFS_VERSION	0
+#define RECORD_OFS_PAGE		1
+#define RECORD_OFS_TIME		2
+#define RECORD_OFS_RANGE	6
+#define RECORD_OFS_FLAGS	7
+#define RECORD_OFS_AVG_CNT	8
+#define RECORD_OFS_TEMP		10
+#define RECORD_OFS_SUPPLY	12
+#define RECORD_OFS_RSSI		14
+#define RECORD_OFS_COUNT	16
+
+// Record flags
+#define RECORD_FFT			0x01
+#define RECORD_TIME			0x02
+#define RECORD_PEAKS		0x04	// Pairs are (position Q8.8, magnitude): X peaks, then Y peaks
+#define RECORD_FEATURES		0x08	// Pair 0 is the X/Y peak, pair 1 the X/Y peak frequency
+
+// Size in bytes of a record holding count X/Y pairs
+#define RECORD_SIZE(count)	(RECORD_HEADER_SIZE + 4 * (uint16_t)(count))
+
+// Header fields in host form. Register values are kept raw; use the ADIS16000 scale functions.
+struct RecordHeader {
+	uint8_t page;
+	uint32_t timestamp;
+	uint8_t range;
+	uint8_t flags;
+	uint16_t avgCnt;
+	int16_t temperature;
+	int16_t supply;
+	int16_t rssi;
+	uint16_t count;
+};
+
+// Summary features of a record, read from the alarm peak registers instead of the full spectrum
+struct SensorFeatures {
+	uint8_t page;
+	uint32_t timestamp;
+	int16_t xPeak;
+	int16_t yPeak;
+	uint16_t xFreq;
+	uint16_t yFreq;
+	int16_t temperature;
+};
+
+// Writes the header into the first RECORD_HEADER_SIZE bytes of record.
+void writeRecordHeader(uint8_t *record, const RecordHeader &header);
+
+// Writes X/Y pair n in place.
+void writeRecordPair(uint8_t *record, uint16_t n, int16_t xData, int16_t yData);
+
+// Read-only view over a record in memory. Nothing is copied; fields are decoded on access.
+class RecordView {
+
+public:
+	RecordView(const uint8_t *data, uint16_t length);
+
+	// True when the buffer holds a complete record of a known version.
+	bool valid() const;
+
+	uint8_t page() const { return _data[RECORD_OFS_PAGE]; }
+	uint32_t timestamp() const;
+	uint8_t range() const { return _data[RECORD_OFS_RANGE]; }
+	uint8_t flags() const { return _data[RECORD_OFS_FLAGS]; }
+	uint16_t avgCnt() const;
+	int16_t temperature() const;
+	int16_t supply() const;
+	int16_t rssi() const;
+	uint16_t count() const;
+
+	// Total record size in bytes.
+	uint16_t size() const { return RECORD_SIZE(count()); }
+
+	// X and Y sample n.
+	int16_t x(uint16_t n) const;
+	int16_t y(uint16_t n) const;
+
+	// Fills header from the record.
+	void header(RecordHeader &header) const;
+
+private:
+	const uint8_t *_data;
+	uint16_t _length;
+
+};
+
+// Little-endian field helpers
+inline void putLE16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+inline uint16_t getLE16(const uint8_t *p) {
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+#endif
@@ -0,0 +1,204 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Rules.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Small diagnostic rule language for records read through the ADIS16000 gateway. Rules such as
+//
+//      band2_3x_rms > 4 mm/s AND kurtosis > 5 -> looseness
+//
+//  are compiled once into a flat decision table and evaluated against each record's feature vector.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Rules.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Condition operators before normalization
+#define OP_GT	0
+#define OP_GE	1
+#define OP_LT	2
+#define OP_LE	3
+
+static bool isNameStart(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool isNameChar(char c) {
+  return isNameStart(c) || (c >= '0' && c <= '9');
+}
+
+static const char *skipSpace(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r')
+    p++;
+  return p;
+}
+
+// Returns the length of the name at p, 0 if there is none
+static uint8_t nameLength(const char *p) {
+  uint8_t n = 0;
+  if (!isNameStart(*p))
+    return 0;
+  while (isNameChar(p[n]) && n < 255)
+    n++;
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Decision table constructor. The table starts empty.
+////////////////////////////////////////////////////////////////////////////
+DecisionTable::DecisionTable() {
+  _conditionCount = 0;
+  _ruleCount = 0;
+  _errorPos = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Compiles a rule set. Each rule is one or more conditions joined by AND,
+// followed by -> and a label:
+//
+//   <feature> <op> <number> [unit] { AND ... } -> <label>
+//
+// where op is one of > >= < <=. A unit after the number is informational
+// and ignored. Conditions are normalized to a single "greater than"
+// compare so evaluation needs no per-operator branches. On error the
+// table is left empty and errorPosition() points at the offending text.
+////////////////////////////////////////////////////////////////////////////
+// text - rules separated by newlines or ';'
+// featureNames - names of the entries of the feature vector
+// featureCount - number of feature names
+////////////////////////////////////////////////////////////////////////////
+int DecisionTable::compile(const char *text, const char *const *featureNames, uint8_t featureCount) {
+  const char *p = text;
+  _conditionCount = 0;
+  _ruleCount = 0;
+  _errorPos = 0;
+
+  for (;;) {
+    p = skipSpace(p);
+    if (*p == '\n' || *p == ';') {
+      p++;
+      continue;
+    }
+    if (*p == '\0')
+      return 1;
+    if (_ruleCount >= RULE_MAX_RULES)
+      break;
+
+    // Conditions
+    for (;;) {
+      p = skipSpace(p);
+      uint8_t len = nameLength(p);
+      uint8_t feature = featureCount;
+      for (uint8_t i = 0; i < featureCount && len; i++) {
+        if (strlen(featureNames[i]) == len && strncmp(featureNames[i], p, len) == 0) {
+          feature = i;
+          break;
+        }
+      }
+      if (feature == featureCount || _conditionCount >= RULE_MAX_CONDITIONS)
+        return compileError(p - text);
+      p = skipSpace(p + len);
+
+      uint8_t op;
+      if (p[0] == '>')
+        op = (p[1] == '=') ? OP_GE : OP_GT;
+      else if (p[0] == '<')
+        op = (p[1] == '=') ? OP_LE : OP_LT;
+      else
+        return compileError(p - text);
+      p += (op == OP_GE || op == OP_LE) ? 2 : 1;
+
+      char *end;
+      float threshold = strtod(p, &end);
+      if (end == p)
+        return compileError(p - text);
+      p = skipSpace(end);
+      if (isNameStart(*p) && !(strncmp(p, "AND", 3) == 0 && !isNameChar(p[3]))) {
+        while (isNameChar(*p) || *p == '/' || *p == '%')
+          p++; // Unit
+        p = skipSpace(p);
+      }
+
+      RuleCondition &c = _conditions[_conditionCount++];
+      c.feature = feature;
+      c.rule = _ruleCount;
+      c.sign = (op == OP_GT || op == OP_LE) ? 1 : -1;
+      c.invert = (op == OP_GE || op == OP_LE) ? 1 : 0;
+      c.threshold = threshold * c.sign;
+
+      if (strncmp(p, "AND", 3) == 0 && !isNameChar(p[3])) {
+        p += 3;
+        continue;
+      }
+      if (p[0] == '-' && p[1] == '>')
+        break;
+      return compileError(p - text);
+    }
+
+    // Label
+    p = skipSpace(p + 2);
+    uint8_t len = nameLength(p);
+    if (len == 0)
+      return compileError(p - text);
+    if (len >= RULE_LABEL_LEN)
+      len = RULE_LABEL_LEN - 1;
+    memcpy(_labels[_ruleCount], p, len);
+    _labels[_ruleCount][len] = '\0';
+    _ruleCount++;
+    p = skipSpace(p + nameLength(p));
+    if (*p != '\n' && *p != ';' && *p != '\0')
+      return compileError(p - text);
+  }
+  return compileError(p - text);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Empties the table after a compile error. Returns 0.
+////////////////////////////////////////////////////////////////////////////
+// pos - offset of the error into the source text
+////////////////////////////////////////////////////////////////////////////
+int DecisionTable::compileError(uint16_t pos) {
+  _errorPos = pos;
+  _conditionCount = 0;
+  _ruleCount = 0;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Evaluates the table. Every condition is checked and failures are OR-ed
+// into a per-rule mask, so the loop has no data dependent branches.
+////////////////////////////////////////////////////////////////////////////
+// features - feature vector, indexed like the names given to compile()
+// return - bit n set when every condition of rule n passed
+////////////////////////////////////////////////////////////////////////////
+uint32_t DecisionTable::evaluate(const float *features) const {
+  uint32_t failed = 0;
+  for (uint8_t i = 0; i < _conditionCount; i++) {
+    const RuleCondition &c = _conditions[i];
+    uint8_t pass = (features[c.feature] * c.sign > c.threshold) ^ c.invert;
+    failed |= (uint32_t)(pass ^ 1) << c.rule;
+  }
+  uint32_t rules = (_ruleCount >= 32) ? 0xFFFFFFFFUL : ((1UL << _ruleCount) - 1);
+  return rules & ~failed;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the label of a rule, or 0 when out of range.
+////////////////////////////////////////////////////////////////////////////
+const char *DecisionTable::label(uint8_t rule) const {
+  if (rule >= _ruleCount)
+    return 0;
+  return _labels[rule];
+}
@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Rules.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Small diagnostic rule language for records read through the ADIS16000 gateway. Rules such as
+//
+//      band2_3x_rms > 4 mm/s AND kurtosis > 5 -> looseness
+//
+//  are compiled once into a flat decision table and evaluated against each record's feature vector.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_RULES_H
+#define ADIS16000_RULES_H
+
+#include "Arduino.h"
+
+// Decision table capacity
+#define RULE_MAX_RULES		16
+#define RULE_MAX_CONDITIONS	32
+#define RULE_LABEL_LEN		12
+
+// One compiled condition. It passes when (value * sign > threshold) != invert.
+struct RuleCondition {
+	uint8_t feature;
+	uint8_t rule;
+	int8_t sign;
+	uint8_t invert;
+	float threshold;
+};
+
+// Rule set compiled to a flat decision table
+class DecisionTable {
+
+public:
+	DecisionTable();
+
+	// Compiles rules separated by newlines or ';'. Feature names index the feature vector. Returns 1 when complete, 0 on error.
+	int compile(const char *text, const char *const *featureNames, uint8_t featureCount);
+
+	// Evaluates all rules. Returns a bit mask with bit n set when rule n matched.
+	uint32_t evaluate(const float *features) const;
+
+	// Label of rule n, or 0 when out of range.
+	const char *label(uint8_t rule) const;
+
+	// Number of compiled rules.
+	uint8_t ruleCount() const { return _ruleCount; }
+
+	// Offset into the source text of the last compile error.
+	uint16_t errorPosition() const { return _errorPos; }
+
+private:
+	int compileError(uint16_t pos);
+
+	RuleCondition _conditions[RULE_MAX_CONDITIONS];
+	char _labels[RULE_MAX_RULES][RULE_LABEL_LEN];
+	uint8_t _conditionCount;
+	uint8_t _ruleCount;
+	uint16_t _errorPos;
+
+};
+
+#endif
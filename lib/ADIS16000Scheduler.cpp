@@ -0,0 +1,384 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Scheduler.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Polling scheduler for networks of ADIS16229 sensors behind one ADIS16000 gateway. Each sensor
+//  reports on its own periodic-mode interval; the scheduler tracks when its next record is due and
+//  hands out polls earliest deadline first within the SPI time the caller can spare.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Scheduler.h"
+
+////////////////////////////////////////////////////////////////////////////
+// Scheduler constructor.
+////////////////////////////////////////////////////////////////////////////
+// table - storage for capacity sensors
+// capacity - largest number of sensors, at most POLL_MAX_SENSORS are used
+////////////////////////////////////////////////////////////////////////////
+PollScheduler::PollScheduler(SensorSchedule *table, uint8_t capacity) {
+  _table = table;
+  _capacity = capacity > POLL_MAX_SENSORS ? POLL_MAX_SENSORS : capacity;
+  _count = 0;
+  _rateUs = 1000; // Whole bus
+  _burstUs = 0x7FFFFFFFUL;
+  _tokens = 0x7FFFFFFFL;
+  _refilled = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Adds a sensor. The period is UPDAT_INT x INT_SCL, matching the values
+// given to ADIS16000::setPeriodicMode. The first record is expected one
+// period from now. Periods past POLL_PERIOD_MAX_MS are rejected.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page
+// interval - UPDAT_INT value
+// scalefactor - INT_SCL value
+// now - current time from millis()
+// return - table index, POLL_NONE when the table is full or the period is too long
+////////////////////////////////////////////////////////////////////////////
+int8_t PollScheduler::addSensor(uint8_t sensorAddr, uint16_t interval, uint8_t scalefactor, uint32_t now) {
+  if (_count >= _capacity)
+    return POLL_NONE;
+  uint64_t periodMs = (uint64_t)interval * (scalefactor ? scalefactor : 1) * PERIODIC_UNIT_MS;
+  if (periodMs > POLL_PERIOD_MAX_MS)
+    return POLL_NONE;
+  SensorSchedule &s = _table[_count];
+  s.sensorAddr = sensorAddr;
+  s.periodMs = (uint32_t)periodMs;
+  s.due = now + s.periodMs;
+  s.lastRecord = 0;
+  s.costUs = POLL_COST_US;
+  s.periodQ8 = (uint64_t)s.periodMs << 8;
+  s.phase = 0;
+  s.offsetLow = 0;
+  s.offsetHigh = 0;
+  s.tracked = 0;
+  s.lastEmpty = now;
+  s.retryMs = POLL_RETRY_MS;
+  s.priority = PRIORITY_NORMAL;
+  s.bandFirst = POLL_BAND_FIRST;
+  s.bandBins = POLL_BAND_BINS;
+  s.mode = POLL_MODE_FULL;
+  s.polls = 0;
+  s.emptyPolls = 0;
+  s.degradedPolls = 0;
+  return _count++;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Removes a sensor. The last entry moves into its place, so indexes of
+// other sensors may change.
+////////////////////////////////////////////////////////////////////////////
+int PollScheduler::removeSensor(uint8_t sensorAddr) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_table[i].sensorAddr == sensorAddr) {
+      _table[i] = _table[--_count];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Sets the priority class of a sensor and the bins read when its polls
+// are degraded to POLL_MODE_BAND.
+////////////////////////////////////////////////////////////////////////////
+// sensorAddr - sensor page
+// priority - PRIORITY_CRITICAL, PRIORITY_NORMAL or PRIORITY_LOW
+// bandFirst, bandBins - first bin and number of bins of the band
+////////////////////////////////////////////////////////////////////////////
+int PollScheduler::setPriority(uint8_t sensorAddr, uint8_t priority, uint8_t bandFirst, uint8_t bandBins) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_table[i].sensorAddr == sensorAddr) {
+      _table[i].priority = priority;
+      _table[i].bandFirst = bandFirst;
+      _table[i].bandBins = bandBins;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Sets the token bucket for SPI time. Polls are charged their measured
+// bus time; the bucket refills at rateUs per millisecond (1000 is the
+// whole bus) up to burstUs, which must hold at least one full read.
+////////////////////////////////////////////////////////////////////////////
+// rateUs - bus microseconds granted per millisecond
+// burstUs - bucket size in microseconds
+// return - 1 when complete, 0 if burstUs is below POLL_COST_US
+////////////////////////////////////////////////////////////////////////////
+int PollScheduler::setBusBudget(uint32_t rateUs, uint32_t burstUs) {
+  if (burstUs < POLL_COST_US)
+    return 0;
+  _rateUs = rateUs;
+  _burstUs = burstUs > 0x7FFFFFFFUL ? 0x7FFFFFFFUL : burstUs;
+  _tokens = (int32_t)_burstUs;
+  return 1;
+}
+
+void PollScheduler::refill(uint32_t now) {
+  uint32_t elapsed = now - _refilled;
+  _refilled = now;
+  int64_t tokens = (int64_t)_tokens + (int64_t)elapsed * _rateUs;
+  _tokens = tokens > (int64_t)_burstUs ? (int32_t)_burstUs : (int32_t)tokens;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Picks the next sensor to poll. Among due sensors the highest priority
+// class goes first, then the earliest deadline. The read mode follows the
+// bus time left in the bucket (and the caller's budgetUs): a full record
+// if it fits, otherwise non-critical sensors degrade to their band, then
+// to alarm features. A critical sensor that does not fit waits for the
+// bucket to refill and holds back lower classes, which bounds its delay;
+// once the bucket is full it reads anyway and leaves the bucket in debt.
+// A critical read longer than budgetUs can never fit this poll, so it is
+// passed over for the next sensor.
+////////////////////////////////////////////////////////////////////////////
+// now - current time from millis()
+// budgetUs - SPI time available for this poll
+// mode - receives the POLL_MODE_ to read with
+// return - table index, POLL_NONE if nothing should be polled now
+////////////////////////////////////////////////////////////////////////////
+int8_t PollScheduler::nextPoll(uint32_t now, uint32_t budgetUs, uint8_t &mode) {
+  refill(now);
+  int8_t best = POLL_NONE;
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((int32_t)(now - _table[i].due) < 0)
+      continue;
+    if (_table[i].priority == PRIORITY_CRITICAL && _table[i].costUs > budgetUs)
+      continue;
+    if (best == POLL_NONE || _table[i].priority < _table[best].priority ||
+      (_table[i].priority == _table[best].priority && (int32_t)(_table[i].due - _table[best].due) < 0))
+      best = i;
+  }
+  if (best == POLL_NONE)
+    return POLL_NONE;
+
+  SensorSchedule &s = _table[best];
+  uint32_t available = _tokens > 0 ? (uint32_t)_tokens : 0;
+  if (budgetUs < available)
+    available = budgetUs;
+  if (s.costUs <= available || (s.priority == PRIORITY_CRITICAL && _tokens >= (int32_t)_burstUs))
+    mode = POLL_MODE_FULL;
+  else if (s.priority == PRIORITY_CRITICAL)
+    return POLL_NONE;
+  else if ((uint32_t)s.bandBins * 2 * POLL_REG_US <= available)
+    mode = POLL_MODE_BAND;
+  else if (6 * POLL_REG_US <= available)
+    mode = POLL_MODE_FEATURES;
+  else
+    return POLL_NONE;
+  s.mode = mode;
+  return best;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Learns the real period and phase of a sensor from its packet times.
+// RF retries and clock drift make arrivals wander from the configured
+// period, so an alpha-beta tracker (an online linear fit of arrival time
+// against record number) follows them: the phase takes 1/4 and the
+// period 1/16 of each prediction error.
+//
+// Packet time and millis() run on different clocks. Their offset is
+// bracketed: a poll that finds the record bounds it from above, an empty
+// poll bounds it from below (see completed()), and polls aim between the
+// two, so the bracket halves with each record. Both bounds relax by 1 ms
+// per record to follow drift. The first record starts the bracket at the
+// last empty poll before it, or a full period back if there was none.
+////////////////////////////////////////////////////////////////////////////
+// s - sensor state
+// now - time of the poll from millis()
+// packetTime - PKT_TIME of the new record in ms
+////////////////////////////////////////////////////////////////////////////
+void PollScheduler::track(SensorSchedule &s, uint32_t now, uint32_t packetTime) {
+  int32_t delay = (int32_t)(now - packetTime);
+  if (!s.tracked) {
+    s.phase = packetTime;
+    s.offsetHigh = delay;
+    s.offsetLow = delay - (int32_t)s.periodMs;
+    if (s.emptyPolls) {
+      int32_t low = (int32_t)(s.lastEmpty - packetTime);
+      if (low > s.offsetLow)
+        s.offsetLow = low;
+    }
+    s.tracked = 1;
+    return;
+  }
+  s.offsetHigh = (delay < s.offsetHigh + 1) ? delay : s.offsetHigh + 1;
+  s.offsetLow--;
+  if (s.offsetLow > s.offsetHigh)
+    s.offsetLow = s.offsetHigh;
+
+  int32_t period = (int32_t)(s.periodQ8 >> 8);
+  int32_t elapsed = (int32_t)(packetTime - s.phase);
+  int32_t periods = period > 0 ? (elapsed + period / 2) / period : 1;
+  if (periods < 1)
+    periods = 1;
+  uint32_t predicted = s.phase + (uint32_t)(((int64_t)s.periodQ8 * periods) >> 8);
+  int32_t error = (int32_t)(packetTime - predicted);
+  if (error > period / 2 || error < -period / 2) {
+    s.phase = packetTime; // Outlier or missed count; restart from this arrival
+    return;
+  }
+  s.phase = predicted + error / 4;
+  s.periodQ8 += ((int64_t)error * 256) / (16 * periods);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Updates a sensor after a poll. A new TIME_STMP updates the arrival
+// model and schedules the next poll just after the predicted arrival; an
+// unchanged one means the record has not arrived yet. Inside the offset
+// bracket the retry bisects what is left of it; once the record is
+// overdue retries back off. The measured SPI time is charged to the bus
+// budget, and full reads keep a running average of it as the readout
+// estimate.
+////////////////////////////////////////////////////////////////////////////
+// index - table index returned by nextPoll
+// now - current time from millis()
+// recordTime - TIME_STMP of the record read
+// packetTime - PKT_TIME of the record in ms (see ADIS16000::readPacketTime)
+// busyUs - SPI time the poll took
+// return - 1 when the record was new, 0 otherwise
+////////////////////////////////////////////////////////////////////////////
+int PollScheduler::completed(int8_t index, uint32_t now, uint32_t recordTime, uint32_t packetTime, uint32_t busyUs) {
+  if (index < 0 || index >= _count)
+    return 0;
+  SensorSchedule &s = _table[index];
+  s.polls++;
+  _tokens -= (int32_t)busyUs;
+  if (s.mode == POLL_MODE_FULL)
+    s.costUs = (3 * s.costUs + busyUs) / 4;
+  else
+    s.degradedPolls++;
+  if (recordTime == s.lastRecord) {
+    s.emptyPolls++;
+    s.lastEmpty = now;
+    int32_t bound = (int32_t)(now - predictedArrival(s)) + 1;
+    if (s.tracked && bound <= s.offsetHigh + POLL_GUARD_MS) {
+      // Not arrived by now, but still inside the bracket: the offset is larger than assumed
+      if (bound > s.offsetLow)
+        s.offsetLow = bound < s.offsetHigh ? bound : s.offsetHigh;
+      s.due = predictedArrival(s) + s.offsetLow + (s.offsetHigh - s.offsetLow) / 2 + POLL_GUARD_MS;
+      if ((int32_t)(s.due - now) < POLL_GUARD_MS)
+        s.due = now + POLL_GUARD_MS;
+      return 0;
+    }
+    // Past the bracket the packet was most likely lost, so the offset is
+    // left alone and retries back off up to half a period, but never past
+    // the poll aimed at the following record
+    s.due = now + s.retryMs;
+    if (s.tracked && (s.periodQ8 >> 8) > 0) {
+      uint32_t next = predictedArrival(s) + (s.offsetLow + s.offsetHigh) / 2 + POLL_GUARD_MS;
+      while ((int32_t)(next - now) <= 0)
+        next += (uint32_t)(s.periodQ8 >> 8);
+      if ((int32_t)(next - s.due) < 0)
+        s.due = next;
+    }
+    uint32_t limit = (s.periodQ8 >> 9) > POLL_RETRY_MS ? (uint32_t)(s.periodQ8 >> 9) : POLL_RETRY_MS;
+    s.retryMs = s.retryMs * 2 > limit ? limit : s.retryMs * 2;
+    return 0;
+  }
+  s.retryMs = POLL_RETRY_MS;
+  s.lastRecord = recordTime;
+  track(s, now, packetTime);
+  s.due = predictedArrival(s) + (s.offsetLow + s.offsetHigh) / 2 + POLL_GUARD_MS;
+  if ((int32_t)(s.due - now) <= 0)
+    s.due = now + (uint32_t)(s.periodQ8 >> 8);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the predicted packet time of the next record.
+////////////////////////////////////////////////////////////////////////////
+uint32_t PollScheduler::predictedArrival(const SensorSchedule &s) const {
+  return s.phase + (uint32_t)(s.periodQ8 >> 8);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns how long the caller can spend on other work before the next
+// sensor is due (0xFFFFFFFF with no sensors).
+////////////////////////////////////////////////////////////////////////////
+uint32_t PollScheduler::idleTime(uint32_t now) const {
+  uint32_t idle = 0xFFFFFFFFUL;
+  for (uint8_t i = 0; i < _count; i++) {
+    int32_t wait = (int32_t)(_table[i].due - now);
+    if (wait <= 0)
+      return 0;
+    if ((uint32_t)wait < idle)
+      idle = wait;
+  }
+  return idle;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Load shedder constructor. Watermarks default to percentages of the
+// output ring.
+////////////////////////////////////////////////////////////////////////////
+// ringSize - size of the FrameWriter ring in bytes
+////////////////////////////////////////////////////////////////////////////
+LoadShedder::LoadShedder(uint16_t ringSize) {
+  setWatermarks((uint32_t)ringSize * SHED_PEAKS_PERCENT / 100,
+    (uint32_t)ringSize * SHED_FEATURES_PERCENT / 100,
+    (uint32_t)ringSize * SHED_HYSTERESIS_PERCENT / 100);
+  _level = SHED_FULL;
+  for (uint8_t i = 0; i < SHED_LEVELS; i++)
+    _records[i] = 0;
+  _shedEvents = 0;
+  _restoreEvents = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Sets the watermarks. The hysteresis keeps the level from flapping when
+// the queue hovers around a watermark.
+////////////////////////////////////////////////////////////////////////////
+// peaksMark - queue depth in bytes that starts SHED_PEAKS
+// featuresMark - queue depth in bytes that starts SHED_FEATURES
+// hysteresis - how far below a watermark the queue must drain to restore
+////////////////////////////////////////////////////////////////////////////
+int LoadShedder::setWatermarks(uint16_t peaksMark, uint16_t featuresMark, uint16_t hysteresis) {
+  _marks[0] = peaksMark;
+  _marks[1] = featuresMark < peaksMark ? peaksMark : featuresMark;
+  _hysteresis = hysteresis > peaksMark ? peaksMark : hysteresis;
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Updates the shed level. Call before each poll.
+////////////////////////////////////////////////////////////////////////////
+// pending - bytes queued for output
+////////////////////////////////////////////////////////////////////////////
+uint8_t LoadShedder::update(uint16_t pending) {
+  while (_level < SHED_LEVELS - 1 && pending >= _marks[_level]) {
+    _level++;
+    _shedEvents++;
+  }
+  while (_level > SHED_FULL && (uint32_t)pending + _hysteresis < _marks[_level - 1]) {
+    _level--;
+    _restoreEvents++;
+  }
+  return _level;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the payload for a sensor. Each class sheds one level later than
+// the class below it, so critical sensors are never shed.
+////////////////////////////////////////////////////////////////////////////
+// priority - PRIORITY_CRITICAL, PRIORITY_NORMAL or PRIORITY_LOW
+////////////////////////////////////////////////////////////////////////////
+uint8_t LoadShedder::payload(uint8_t priority) const {
+  uint8_t delay = priority >= PRIORITY_LOW ? 0 : PRIORITY_LOW - priority;
+  return _level > delay ? _level - delay : SHED_FULL;
+}
@@ -0,0 +1,196 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Scheduler.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Polling scheduler for networks of ADIS16229 sensors behind one ADIS16000 gateway. Each sensor
+//  reports on its own periodic-mode interval; the scheduler tracks when its next record is due and
+//  hands out polls earliest deadline first within the SPI time the caller can spare. A load
+//  shedder switches sensors to smaller payloads while the output link falls behind.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_SCHEDULER_H
+#define ADIS16000_SCHEDULER_H
+
+#include "Arduino.h"
+
+// Milliseconds per UPDAT_INT count
+#define PERIODIC_UNIT_MS	1000UL
+
+// Retry delay after a poll that found no new record
+#define POLL_RETRY_MS		50
+
+// Starting estimate of the SPI time for one FFT record readout
+#define POLL_COST_US		25000UL
+
+// Longest period the scheduler can track; deadlines compare as signed 32-bit ms
+#define POLL_PERIOD_MAX_MS	0x3FFFFFFFUL
+
+// Margin after the predicted arrival before a sensor is polled
+#define POLL_GUARD_MS		5
+
+// SPI time per register read, used to cost partial reads
+#define POLL_REG_US			50
+
+// No sensor to poll
+#define POLL_NONE			-1
+
+// Largest sensor table; indexes are int8_t so they stay clear of POLL_NONE
+#define POLL_MAX_SENSORS	127
+
+// Priority classes, most important first. Only critical sensors never degrade.
+#define PRIORITY_CRITICAL	0
+#define PRIORITY_NORMAL		1
+#define PRIORITY_LOW		2
+
+// Read modes handed out with a poll, from most to least bus time
+#define POLL_MODE_FULL		0	// Full X/Y FFT record
+#define POLL_MODE_BAND		1	// Configured bin band only (readFFTBand)
+#define POLL_MODE_FEATURES	2	// Alarm peak features only (readFeatures)
+
+// Default band for degraded reads: the low bins that carry running speed harmonics
+#define POLL_BAND_FIRST		0
+#define POLL_BAND_BINS		64
+
+// Scheduling state of one sensor
+struct SensorSchedule {
+	uint8_t sensorAddr;
+	uint32_t periodMs;
+	uint32_t due;
+	uint32_t lastRecord;
+	uint32_t costUs;
+	uint64_t periodQ8;
+	uint32_t phase;
+	int32_t offsetLow;
+	int32_t offsetHigh;
+	uint8_t tracked;
+	uint32_t lastEmpty;
+	uint32_t retryMs;
+	uint8_t priority;
+	uint8_t bandFirst;
+	uint8_t bandBins;
+	uint8_t mode;
+	uint32_t polls;
+	uint32_t emptyPolls;
+	uint32_t degradedPolls;
+};
+
+// Earliest-deadline-first poll scheduler over a caller-provided sensor table,
+// with priority classes and a token bucket limiting SPI bus time
+class PollScheduler {
+
+public:
+	PollScheduler(SensorSchedule *table, uint8_t capacity);
+
+	// Adds a sensor configured with setPeriodicMode(interval, scalefactor). Returns its index, POLL_NONE when full or the period is too long.
+	int8_t addSensor(uint8_t sensorAddr, uint16_t interval, uint8_t scalefactor, uint32_t now);
+
+	// Removes a sensor. Returns 1 when complete, 0 if not found.
+	int removeSensor(uint8_t sensorAddr);
+
+	// Sets the priority class and degraded-read band of a sensor. Returns 1 when complete, 0 if not found.
+	int setPriority(uint8_t sensorAddr, uint8_t priority, uint8_t bandFirst, uint8_t bandBins);
+
+	// Limits bus time to rateUs per ms with bursts up to burstUs. Returns 1 when complete, 0 if burstUs cannot hold a full read.
+	int setBusBudget(uint32_t rateUs, uint32_t burstUs);
+
+	// Next due sensor by priority, then deadline, and the read mode that fits the bus budget. Returns its index or POLL_NONE.
+	int8_t nextPoll(uint32_t now, uint32_t budgetUs, uint8_t &mode);
+
+	// Reports a finished poll with the record TIME_STMP, its packet time (ms) and the SPI time it took. Returns 1 if it was a new record.
+	int completed(int8_t index, uint32_t now, uint32_t recordTime, uint32_t packetTime, uint32_t busyUs);
+
+	// Learned period of a sensor in ms (with 8 fraction bits in periodQ8).
+	uint32_t period(int8_t index) const { return (uint32_t)(_table[index].periodQ8 >> 8); }
+
+	// Milliseconds until the next sensor is due, 0 if one is due now.
+	uint32_t idleTime(uint32_t now) const;
+
+	// Sensor table entry.
+	SensorSchedule &sensor(int8_t index) { return _table[index]; }
+
+	// Number of sensors scheduled.
+	uint8_t count() const { return _count; }
+
+private:
+	void track(SensorSchedule &s, uint32_t now, uint32_t packetTime);
+	uint32_t predictedArrival(const SensorSchedule &s) const;
+	void refill(uint32_t now);
+
+	SensorSchedule *_table;
+	uint8_t _capacity;
+	uint8_t _count;
+	uint32_t _rateUs;
+	uint32_t _burstUs;
+	int32_t _tokens;
+	uint32_t _refilled;
+
+};
+
+// Output payloads, from largest to smallest
+#define SHED_FULL			0	// Full X/Y FFT record
+#define SHED_PEAKS			1	// Largest peaks of each axis
+#define SHED_FEATURES		2	// Alarm peak features only
+#define SHED_LEVELS			3
+
+// Peaks per axis in a SHED_PEAKS record
+#define SHED_PEAK_COUNT		8
+
+// Default watermarks in percent of the output ring
+#define SHED_PEAKS_PERCENT		50
+#define SHED_FEATURES_PERCENT	75
+#define SHED_HYSTERESIS_PERCENT	25
+
+// Chooses record payloads from the output queue depth. The shed level
+// rises as the queue passes each watermark and falls once it drains below
+// the watermark less the hysteresis. At each level low priority sensors
+// shed first; critical sensors always send full records.
+class LoadShedder {
+
+public:
+	LoadShedder(uint16_t ringSize);
+
+	// Queue depths in bytes that raise the level to SHED_PEAKS and SHED_FEATURES. Returns 1 when complete.
+	int setWatermarks(uint16_t peaksMark, uint16_t featuresMark, uint16_t hysteresis);
+
+	// Updates the level from the bytes queued for output (FrameWriter::pending). Returns the level.
+	uint8_t update(uint16_t pending);
+
+	// Payload for a sensor of the given PRIORITY_ class at the current level.
+	uint8_t payload(uint8_t priority) const;
+
+	// Counts a record sent with the given payload.
+	void sent(uint8_t payload) { _records[payload]++; }
+
+	// Current shed level (SHED_FULL when not shedding).
+	uint8_t level() const { return _level; }
+
+	// Records sent with each payload.
+	uint32_t records(uint8_t payload) const { return _records[payload]; }
+
+	// Times the level rose and fell.
+	uint32_t shedEvents() const { return _shedEvents; }
+	uint32_t restoreEvents() const { return _restoreEvents; }
+
+private:
+	uint16_t _marks[SHED_LEVELS - 1];
+	uint16_t _hysteresis;
+	uint8_t _level;
+	uint32_t _records[SHED_LEVELS];
+	uint32_t _shedEvents;
+	uint32_t _restoreEvents;
+
+};
+
+#endif
@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Search.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Similarity search over archived spectra. Records are reduced to unit-length int8 vectors of
+//  their per-bin X/Y vector magnitude, and queries are answered by brute-force cosine scoring.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Search.h"
+
+////////////////////////////////////////////////////////////////////////////
+// Integer square root of a 64 bit value, rounded down.
+////////////////////////////////////////////////////////////////////////////
+static uint32_t isqrt64(uint64_t value) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value)
+    bit >>= 2;
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Scales values to unit length in int8. Vectors are stored this way once,
+// so a query only needs dot products, which equal cosine similarity. The
+// energy is summed unscaled in 64 bits, so low level spectra keep their
+// precision.
+////////////////////////////////////////////////////////////////////////////
+static int normalizeValues(const uint16_t *values, int8_t *vector) {
+  uint64_t energy = 0;
+  for (uint16_t i = 0; i < SEARCH_DIM; i++)
+    energy += (uint32_t)values[i] * values[i];
+  uint32_t norm = isqrt64(energy);
+  if (norm == 0)
+    return 0;
+  for (uint16_t i = 0; i < SEARCH_DIM; i++) {
+    uint32_t scaled = ((uint32_t)values[i] * SEARCH_UNIT + norm / 2) / norm;
+    vector[i] = (int8_t)(scaled > SEARCH_UNIT ? SEARCH_UNIT : scaled);
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Normalizes a spectrum. Negative bins count as 0.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - SEARCH_DIM FFT magnitudes
+// vector - receives SEARCH_DIM values
+////////////////////////////////////////////////////////////////////////////
+int normalizeSpectrum(const int16_t *spectrum, int8_t *vector) {
+  uint16_t values[SEARCH_DIM];
+  for (uint16_t i = 0; i < SEARCH_DIM; i++)
+    values[i] = spectrum[i] > 0 ? spectrum[i] : 0;
+  return normalizeValues(values, vector);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Normalizes the per-bin vector magnitude sqrt(X^2 + Y^2) of a record, so
+// similar signatures match regardless of sensor mounting angle.
+////////////////////////////////////////////////////////////////////////////
+// record - FFT record
+// vector - receives SEARCH_DIM values
+////////////////////////////////////////////////////////////////////////////
+int normalizeRecord(const RecordView &record, int8_t *vector) {
+  uint16_t values[SEARCH_DIM];
+  for (uint16_t i = 0; i < SEARCH_DIM; i++) {
+    int32_t x = i < record.count() && record.x(i) > 0 ? record.x(i) : 0;
+    int32_t y = i < record.count() && record.y(i) > 0 ? record.y(i) : 0;
+    values[i] = isqrt32((uint32_t)(x * x + y * y));
+  }
+  return normalizeValues(values, vector);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Dot product of two vectors. The fixed length loop with a single int32
+// accumulator is written so host compilers vectorize it.
+////////////////////////////////////////////////////////////////////////////
+int32_t vectorDot(const int8_t *a, const int8_t *b) {
+  int32_t sum = 0;
+  for (uint16_t i = 0; i < SEARCH_DIM; i++)
+    sum += (int16_t)a[i] * b[i];
+  return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Index constructor. Vectors and ids must outlive the index; on a host
+// they are typically mapped straight from the vector file.
+////////////////////////////////////////////////////////////////////////////
+// vectors - count * SEARCH_DIM normalized values
+// ids - count record ids
+// count - number of vectors
+////////////////////////////////////////////////////////////////////////////
+SpectrumIndex::SpectrumIndex(const int8_t *vectors, const uint32_t *ids, uint32_t count) {
+  _vectors = vectors;
+  _ids = ids;
+  _count = count;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Scores every vector against the query and keeps the best k in a min-
+// heap, the same way the spectral peak picker does.
+////////////////////////////////////////////////////////////////////////////
+// query - normalized query vector
+// hits - caller storage for k results
+// k - number of results wanted
+// return - number of hits, most similar first
+////////////////////////////////////////////////////////////////////////////
+uint8_t SpectrumIndex::search(const int8_t *query, SearchHit *hits, uint8_t k) const {
+  uint8_t count = 0;
+  if (k == 0)
+    return 0;
+  for (uint32_t n = 0; n < _count; n++) {
+    int32_t score = vectorDot(query, _vectors + n * SEARCH_DIM);
+    if (count == k && score <= hits[0].score)
+      continue;
+    SearchHit hit = { _ids[n], score };
+    uint8_t i;
+    if (count < k) {
+      i = count++;
+      while (i > 0 && hits[(i - 1) / 2].score > score) {
+        hits[i] = hits[(i - 1) / 2];
+        i = (i - 1) / 2;
+      }
+    }
+    else {
+      i = 0;
+      for (;;) {
+        uint16_t child = 2 * i + 1;
+        if (child >= count)
+          break;
+        if (child + 1 < count && hits[child + 1].score < hits[child].score)
+          child++;
+        if (hits[child].score >= score)
+          break;
+        hits[i] = hits[child];
+        i = child;
+      }
+    }
+    hits[i] = hit;
+  }
+
+  // Heap sort, leaving the best hit first
+  for (uint8_t n = count; n > 1; n--) {
+    SearchHit last = hits[n - 1];
+    hits[n - 1] = hits[0];
+    uint8_t i = 0;
+    for (;;) {
+      uint16_t child = 2 * i + 1;
+      if (child >= n - 1)
+        break;
+      if (child + 1 < n - 1 && hits[child + 1].score < hits[child].score)
+        child++;
+      if (hits[child].score >= last.score)
+        break;
+      hits[i] = hits[child];
+      i = child;
+    }
+    hits[i] = last;
+  }
+  return count;
+}
@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Search.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Similarity search over archived spectra. Records are reduced to unit-length int8 vectors of
+//  their per-bin X/Y vector magnitude, and queries are answered by brute-force cosine scoring.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_SEARCH_H
+#define ADIS16000_SEARCH_H
+
+#include "Arduino.h"
+#include "ADIS16000Spectrum.h"
+#include "ADIS16000Record.h"
+
+// Length of a search vector and the int8 value of a unit component
+#define SEARCH_DIM			FFT_BINS
+#define SEARCH_UNIT			127
+
+// One search result. Score is the cosine similarity scaled by SEARCH_UNIT^2.
+struct SearchHit {
+	uint32_t id;
+	int32_t score;
+};
+
+// Normalizes a spectrum to a unit-length int8 vector. Returns 1 when complete, 0 for an all-zero spectrum.
+int normalizeSpectrum(const int16_t *spectrum, int8_t *vector);
+
+// Normalizes the X/Y vector magnitude of a record. Returns 1 when complete, 0 for an empty record.
+int normalizeRecord(const RecordView &record, int8_t *vector);
+
+// Dot product of two search vectors.
+int32_t vectorDot(const int8_t *a, const int8_t *b);
+
+// Brute-force index over caller-owned vectors (SEARCH_DIM bytes each) and ids
+class SpectrumIndex {
+
+public:
+	SpectrumIndex(const int8_t *vectors, const uint32_t *ids, uint32_t count);
+
+	// Finds the k most similar vectors. Returns the number of hits, best first.
+	uint8_t search(const int8_t *query, SearchHit *hits, uint8_t k) const;
+
+private:
+	const int8_t *_vectors;
+	const uint32_t *_ids;
+	uint32_t _count;
+
+};
+
+#endif
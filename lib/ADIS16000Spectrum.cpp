@@ -0,0 +1,703 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Spectrum.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Spectrum analysis helpers for the 256-bin ADIS16229 FFT records read through the ADIS16000
+//  gateway. Everything here works on caller-provided storage and never allocates, so it can run
+//  on the Arduino between SPI reads as well as on a host processing exported records.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Spectrum.h"
+
+// Number of harmonics scored by the running speed comb
+#define COMB_HARMONICS	3
+
+// Comb search step in 1/256 bin
+#define COMB_STEP		64
+
+// Quarter wave of cos(pi * i / 256) in Q14, used by the cepstrum
+static const int16_t cosTable[129] PROGMEM = {
+  16384, 16383, 16379, 16373, 16364, 16353, 16340, 16324, 16305, 16284, 16261, 16235,
+  16207, 16176, 16143, 16107, 16069, 16029, 15986, 15941, 15893, 15843, 15791, 15736,
+  15679, 15619, 15557, 15493, 15426, 15357, 15286, 15213, 15137, 15059, 14978, 14896,
+  14811, 14724, 14635, 14543, 14449, 14354, 14256, 14155, 14053, 13949, 13842, 13733,
+  13623, 13510, 13395, 13279, 13160, 13039, 12916, 12792, 12665, 12537, 12406, 12274,
+  12140, 12004, 11866, 11727, 11585, 11442, 11297, 11151, 11003, 10853, 10702, 10549,
+  10394, 10238, 10080, 9921, 9760, 9598, 9434, 9269, 9102, 8935, 8765, 8595,
+  8423, 8250, 8076, 7900, 7723, 7545, 7366, 7186, 7005, 6823, 6639, 6455,
+  6270, 6084, 5897, 5708, 5520, 5330, 5139, 4948, 4756, 4563, 4370, 4176,
+  3981, 3786, 3590, 3393, 3196, 2999, 2801, 2603, 2404, 2205, 2006, 1806,
+  1606, 1406, 1205, 1005, 804, 603, 402, 201, 0
+};
+
+////////////////////////////////////////////////////////////////////////////
+// Parabolic fit through three bins around a local maximum.
+////////////////////////////////////////////////////////////////////////////
+// left, center, right - magnitudes around the peak
+// offset - receives the sub-bin offset of the vertex in 1/256 bin
+// return - interpolated peak height
+////////////////////////////////////////////////////////////////////////////
+static int32_t interpolateParabolic(int16_t left, int16_t center, int16_t right, int16_t &offset) {
+  int32_t den = (int32_t)left - 2 * (int32_t)center + right; // Always negative at a peak
+  offset = 0;
+  if (den == 0)
+    return center;
+  int32_t num = (int32_t)left - right;
+  offset = (int16_t)((num * 128) / den);
+  return center - (num * offset) / 1024;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Peak picker constructor. Call begin() before pushing bins.
+////////////////////////////////////////////////////////////////////////////
+SpectrumPeakPicker::SpectrumPeakPicker() {
+  begin(0, 0, PEAK_INTERP_NONE);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Starts a new record.
+////////////////////////////////////////////////////////////////////////////
+// peaks - caller storage for at least k peaks
+// k - number of peaks to keep
+// interp - PEAK_INTERP_NONE, PEAK_INTERP_PARABOLIC or PEAK_INTERP_GAUSSIAN
+////////////////////////////////////////////////////////////////////////////
+void SpectrumPeakPicker::begin(SpectrumPeak *peaks, uint8_t k, uint8_t interp) {
+  _peaks = peaks;
+  _k = (peaks == 0) ? 0 : k;
+  _count = 0;
+  _interp = interp;
+  _bin = 0;
+  _prev1 = 0;
+  _prev2 = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Pushes the next bin. A bin is a peak when it is larger than the bin
+// before it and no smaller than the bin after it, so flat tops are only
+// reported once. The first and last bins are never reported.
+////////////////////////////////////////////////////////////////////////////
+// sensorData - raw FFT magnitude of the next bin
+////////////////////////////////////////////////////////////////////////////
+void SpectrumPeakPicker::push(int16_t sensorData) {
+  if (_bin >= 2 && _prev1 > _prev2 && _prev1 >= sensorData)
+    insert(_prev2, _prev1, sensorData, _bin - 1);
+  _prev2 = _prev1;
+  _prev1 = sensorData;
+  _bin++;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Restores the min-heap property below entry i of an n entry heap.
+////////////////////////////////////////////////////////////////////////////
+void SpectrumPeakPicker::siftDown(uint8_t i, uint8_t n) {
+  for (;;) {
+    uint8_t smallest = i;
+    uint16_t left = 2 * i + 1;
+    uint16_t right = left + 1;
+    if (left < n && _peaks[left].magnitude < _peaks[smallest].magnitude)
+      smallest = left;
+    if (right < n && _peaks[right].magnitude < _peaks[smallest].magnitude)
+      smallest = right;
+    if (smallest == i)
+      return;
+    SpectrumPeak tmp = _peaks[i];
+    _peaks[i] = _peaks[smallest];
+    _peaks[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Interpolates a local maximum and offers it to the heap. Interpolation is
+// only done for peaks that make it into the heap.
+////////////////////////////////////////////////////////////////////////////
+// left, center, right - magnitudes around the peak
+// bin - bin index of center
+////////////////////////////////////////////////////////////////////////////
+void SpectrumPeakPicker::insert(int16_t left, int16_t center, int16_t right, uint8_t bin) {
+  if (_k == 0)
+    return;
+  if (_count == _k && center <= _peaks[0].magnitude)
+    return;
+
+  int16_t offset = 0; // Sub-bin offset in 1/256 bin
+  int32_t height = center;
+  if (_interp == PEAK_INTERP_PARABOLIC) {
+    height = interpolateParabolic(left, center, right, offset);
+  }
+  else if (_interp == PEAK_INTERP_GAUSSIAN && left > 0 && center > 0 && right > 0) {
+    float la = log((float)left);
+    float lb = log((float)center);
+    float lc = log((float)right);
+    float d = la - 2 * lb + lc;
+    if (d != 0) {
+      float delta = 0.5 * (la - lc) / d;
+      offset = (int16_t)(delta * 256);
+      height = (int32_t)exp(lb - 0.25 * (la - lc) * delta);
+    }
+  }
+  if (height > 32767)
+    height = 32767;
+
+  SpectrumPeak peak;
+  peak.position = (uint16_t)(((int32_t)bin << 8) + offset);
+  peak.magnitude = (int16_t)height;
+
+  if (_count < _k) {
+    // Sift up into the min-heap
+    uint8_t i = _count++;
+    while (i > 0) {
+      uint8_t parent = (i - 1) / 2;
+      if (_peaks[parent].magnitude <= peak.magnitude)
+        break;
+      _peaks[i] = _peaks[parent];
+      i = parent;
+    }
+    _peaks[i] = peak;
+  }
+  else {
+    // Replace the smallest peak
+    _peaks[0] = peak;
+    siftDown(0, _count);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Heap-sorts the peaks in place. Sorting a min-heap this way leaves the
+// largest peak first. Returns the number of peaks found.
+////////////////////////////////////////////////////////////////////////////
+uint8_t SpectrumPeakPicker::finish() {
+  for (uint8_t n = _count; n > 1; n--) {
+    SpectrumPeak tmp = _peaks[0];
+    _peaks[0] = _peaks[n - 1];
+    _peaks[n - 1] = tmp;
+    siftDown(0, n - 1);
+  }
+  return _count;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Finds the k largest peaks in a complete spectrum.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins in spectrum
+// peaks - caller storage for at least k peaks
+// k - number of peaks to keep
+// interp - sub-bin interpolation mode
+// return - number of peaks found, largest first
+////////////////////////////////////////////////////////////////////////////
+uint8_t findPeaks(const int16_t *spectrum, uint16_t bins, SpectrumPeak *peaks, uint8_t k, uint8_t interp) {
+  SpectrumPeakPicker picker;
+  picker.begin(peaks, k, interp);
+  for (uint16_t i = 0; i < bins; i++)
+    picker.push(spectrum[i]);
+  return picker.finish();
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Converts a Q8.8 peak position to frequency.
+////////////////////////////////////////////////////////////////////////////
+// peak - peak returned by the picker
+// binWidth - FFT bin width in Hz
+// return - peak frequency in Hz
+////////////////////////////////////////////////////////////////////////////
+float peakFrequency(const SpectrumPeak &peak, float binWidth) {
+  return (peak.position / 256.0) * binWidth;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the largest magnitude within one bin of a Q8.8 position, or -1
+// when the position falls outside the spectrum. The one bin tolerance
+// absorbs the rounding of higher harmonics. The DC bin is never a
+// harmonic, so a large DC bin cannot win the comb.
+////////////////////////////////////////////////////////////////////////////
+static int16_t harmonicAmplitude(const int16_t *spectrum, uint16_t bins, uint32_t position, uint16_t *binOut) {
+  uint32_t center = (position + 128) >> 8;
+  if (center + 1 >= bins || center < 1)
+    return -1;
+  uint16_t best = center;
+  if (center > 1 && spectrum[center - 1] > spectrum[best])
+    best = center - 1;
+  if (spectrum[center + 1] > spectrum[best])
+    best = center + 1;
+  if (binOut)
+    *binOut = best;
+  return spectrum[best];
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Comb score of a candidate fundamental: the sum of the 1x..3x harmonic
+// amplitudes. Returns -1 if any harmonic is outside the spectrum.
+////////////////////////////////////////////////////////////////////////////
+static int32_t combScore(const int16_t *spectrum, uint16_t bins, uint16_t position) {
+  int32_t score = 0;
+  for (uint8_t h = 1; h <= COMB_HARMONICS; h++) {
+    int16_t amp = harmonicAmplitude(spectrum, bins, (uint32_t)position * h, 0);
+    if (amp < 0)
+      return -1;
+    score += amp;
+  }
+  return score;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Fills in the harmonic amplitudes and ratios for a chosen fundamental.
+// The 1x position is refined with a parabolic fit around its largest bin.
+////////////////////////////////////////////////////////////////////////////
+static void fillRunningSpeed(const int16_t *spectrum, uint16_t bins, uint16_t position, bool refine, RunningSpeed &result) {
+  uint16_t bin = 0;
+  int16_t amp1 = harmonicAmplitude(spectrum, bins, position, &bin);
+  if (amp1 < 0)
+    amp1 = 0;
+  else if (refine && bin > 0 && bin + 1 < bins) {
+    int16_t offset = 0;
+    interpolateParabolic(spectrum[bin - 1], spectrum[bin], spectrum[bin + 1], offset);
+    position = (uint16_t)(((int32_t)bin << 8) + offset);
+  }
+  result.position = position;
+  result.amplitude[0] = amp1;
+  result.amplitude[1] = harmonicAmplitude(spectrum, bins, (uint32_t)position * 2, 0);
+  result.amplitude[2] = harmonicAmplitude(spectrum, bins, (uint32_t)position * 3, 0);
+  for (uint8_t h = 1; h < 3; h++) {
+    // Refinement can move a harmonic past the last bin
+    if (result.amplitude[h] < 0)
+      result.amplitude[h] = 0;
+    uint32_t ratio = 0;
+    if (amp1 > 0 && result.amplitude[h] > 0)
+      ratio = ((uint32_t)result.amplitude[h] << 8) / amp1;
+    if (ratio > 0xFFFF)
+      ratio = 0xFFFF;
+    if (h == 1)
+      result.ratio2x = (uint16_t)ratio;
+    else
+      result.ratio3x = (uint16_t)ratio;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Estimates shaft running speed with a harmonic comb. Every candidate
+// between minBin and maxBin (in quarter bin steps) is scored by the sum of
+// its 1x, 2x and 3x amplitudes. Ties go to the higher candidate, which
+// keeps subharmonics of the true speed from winning. Integer math only.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins in spectrum
+// minBin, maxBin - search range for the 1x frequency in bins
+// result - receives the estimate
+// return - 1 when an estimate was found, 0 otherwise
+////////////////////////////////////////////////////////////////////////////
+uint8_t estimateRunningSpeed(const int16_t *spectrum, uint16_t bins, uint16_t minBin, uint16_t maxBin, RunningSpeed &result) {
+  int32_t bestScore = -1;
+  uint16_t best = 0;
+  if (minBin < 1)
+    minBin = 1;
+  for (uint32_t position = (uint32_t)minBin << 8; position <= ((uint32_t)maxBin << 8); position += COMB_STEP) {
+    int32_t score = combScore(spectrum, bins, (uint16_t)position);
+    if (score < 0)
+      break;
+    if (score >= bestScore) {
+      bestScore = score;
+      best = (uint16_t)position;
+    }
+  }
+  if (bestScore <= 0)
+    return 0;
+  fillRunningSpeed(spectrum, bins, best, true, result);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Estimates shaft running speed from peaks already picked for the record.
+// Each peak is tried as the 1x, 2x and 3x harmonic, so only a handful of
+// candidates are scored. The winning 1x keeps the interpolated position
+// of its peak when the peak itself is the fundamental.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins in spectrum
+// peaks, count - peaks from SpectrumPeakPicker or findPeaks
+// minBin, maxBin - search range for the 1x frequency in bins
+// result - receives the estimate
+// return - 1 when an estimate was found, 0 otherwise
+////////////////////////////////////////////////////////////////////////////
+uint8_t estimateRunningSpeed(const int16_t *spectrum, uint16_t bins, const SpectrumPeak *peaks, uint8_t count,
+  uint16_t minBin, uint16_t maxBin, RunningSpeed &result) {
+  int32_t bestScore = -1;
+  uint16_t best = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    for (uint8_t h = 1; h <= COMB_HARMONICS; h++) {
+      uint16_t position = peaks[i].position / h;
+      if (position < ((uint32_t)minBin << 8) || position > ((uint32_t)maxBin << 8))
+        continue;
+      int32_t score = combScore(spectrum, bins, position);
+      if (score > bestScore || (score == bestScore && position > best)) {
+        bestScore = score;
+        best = position;
+      }
+    }
+  }
+  if (bestScore <= 0)
+    return 0;
+  fillRunningSpeed(spectrum, bins, best, false, result);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Converts a running speed estimate to shaft speed.
+////////////////////////////////////////////////////////////////////////////
+// speed - estimate from estimateRunningSpeed
+// binWidth - FFT bin width in Hz
+// return - shaft speed in RPM
+////////////////////////////////////////////////////////////////////////////
+float runningSpeedRPM(const RunningSpeed &speed, float binWidth) {
+  return (speed.position / 256.0) * binWidth * 60;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns cos(2 * pi * m / 512) in Q14 from the quarter wave table.
+////////////////////////////////////////////////////////////////////////////
+static int16_t cosQ14(uint16_t m) {
+  m &= 511;
+  if (m <= 128)
+    return (int16_t)pgm_read_word(&cosTable[m]);
+  if (m <= 256)
+    return -(int16_t)pgm_read_word(&cosTable[256 - m]);
+  if (m <= 384)
+    return -(int16_t)pgm_read_word(&cosTable[m - 256]);
+  return (int16_t)pgm_read_word(&cosTable[512 - m]);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Fast log2 with 8 fractional bits. The fraction is the linear
+// interpolation between powers of two (error below 0.09).
+////////////////////////////////////////////////////////////////////////////
+static int16_t log2Q8(int16_t sensorData) {
+  if (sensorData <= 1)
+    return 0;
+  uint16_t x = (uint16_t)sensorData;
+  uint8_t msb = 15;
+  while (!(x & 0x8000)) {
+    x <<= 1;
+    msb--;
+  }
+  return (int16_t)((msb << 8) | ((x >> 7) & 0xFF));
+}
+
+////////////////////////////////////////////////////////////////////////////
+// One cepstrum sample from a 256-bin log spectrum. The log spectrum is
+// mirrored to the full 512 point record, so the inverse FFT reduces to a
+// cosine sum. The missing Nyquist bin is taken equal to the last bin.
+////////////////////////////////////////////////////////////////////////////
+// logData - log2 spectrum in Q8
+// q - quefrency in samples (0 - 255)
+// return - cepstrum sample, log2 units in Q10
+////////////////////////////////////////////////////////////////////////////
+static int16_t cepstrumAt(const int16_t *logData, uint16_t q) {
+  int32_t acc = ((int32_t)logData[0] * cosQ14(0)) >> 8;
+  acc += ((int32_t)logData[FFT_BINS - 1] * cosQ14(FFT_BINS * q)) >> 8;
+  for (uint16_t k = 1; k < FFT_BINS; k++)
+    acc += (((int32_t)logData[k] * cosQ14(k * q)) >> 8) * 2;
+  return (int16_t)(acc >> 13); // Divide by 512 points and convert Q14 to Q10
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Magnitude of one cepstrum sample of an unmirrored 256-bin log spectrum.
+// Sidebands spaced D bins around a carrier at C give a real cepstrum peak
+// at 512 / D scaled by cos(2 * pi * C / D), which vanishes or turns
+// negative unless the carrier sits on a multiple of the spacing. Taking
+// the cosine and sine sums together removes the carrier term.
+////////////////////////////////////////////////////////////////////////////
+// logData - windowed log2 spectrum in Q8, mean removed
+// q - quefrency in samples (0 - 255)
+// return - cepstrum magnitude, log2 units in Q10
+////////////////////////////////////////////////////////////////////////////
+static int16_t cepstrumMagnitude(const int16_t *logData, uint16_t q) {
+  int32_t re = 0;
+  int32_t im = 0;
+  for (uint16_t k = 0; k < FFT_BINS; k++) {
+    uint16_t m = k * q;
+    re += ((int32_t)logData[k] * cosQ14(m)) >> 8;
+    im += ((int32_t)logData[k] * cosQ14(m - 128)) >> 8;
+  }
+  re >>= 12; // Divide by 512 points, double for the negative frequencies and convert Q14 to Q10
+  im >>= 12;
+  uint16_t magnitude = isqrt32((uint32_t)(re * re) + (uint32_t)(im * im));
+  return magnitude > 32767 ? 32767 : (int16_t)magnitude;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Computes the real cepstrum of a 256-bin magnitude spectrum in fixed
+// point, without a complex FFT buffer. This is O(N^2), so on AVR it takes
+// a few hundred milliseconds per axis.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - 256 FFT magnitudes
+// logScratch - 256 entries, receives the log2 spectrum in Q8
+// out - receives 256 cepstrum samples, log2 units in Q10
+////////////////////////////////////////////////////////////////////////////
+void cepstrum(const int16_t *spectrum, int16_t *logScratch, int16_t *out) {
+  for (uint16_t k = 0; k < FFT_BINS; k++)
+    logScratch[k] = log2Q8(spectrum[k]);
+  for (uint16_t q = 0; q < FFT_BINS; q++)
+    out[q] = cepstrumAt(logScratch, q);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Counts sideband lines around a carrier.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins in spectrum
+// carrier - carrier position in bins (Q8.8)
+// spacing - sideband spacing in bins (Q8.8)
+// threshold - smallest magnitude counted as a sideband
+// maxOrder - highest sideband order checked on each side
+// return - number of sideband lines found on both sides
+////////////////////////////////////////////////////////////////////////////
+uint8_t countSidebands(const int16_t *spectrum, uint16_t bins, uint16_t carrier, uint16_t spacing, int16_t threshold, uint8_t maxOrder) {
+  uint8_t found = 0;
+  for (uint8_t n = 1; n <= maxOrder; n++) {
+    int32_t offset = (int32_t)spacing * n;
+    if ((int32_t)carrier - offset >= 256 && harmonicAmplitude(spectrum, bins, carrier - offset, 0) >= threshold)
+      found++;
+    if (harmonicAmplitude(spectrum, bins, carrier + offset, 0) >= threshold)
+      found++;
+  }
+  return found;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Cepstrum and sideband analysis of one record. The log spectrum has its
+// mean removed and a Hann window applied, and its cepstrum magnitude (see
+// cepstrumMagnitude) is searched above CEPSTRUM_MIN_QUEFRENCY. A sideband
+// family repeats at every multiple of its quefrency with similar height,
+// so the largest peak is often a rahmonic: the lowest of the
+// CEPSTRUM_CANDIDATES largest peaks that reaches CEPSTRUM_PEAK_FRACTION of
+// the largest is taken as the fundamental. It gives the sideband spacing,
+// which is then checked around the largest spectral peaks. Quefrency peaks
+// below CEPSTRUM_MIN_PEAK are ignored. Sidebands must be at least twice
+// the mean magnitude of the record. Cepstrum samples are fed straight to a
+// peak picker, so only the log spectrum is buffered. This takes twice the
+// time of cepstrum().
+////////////////////////////////////////////////////////////////////////////
+// spectrum - 256 FFT magnitudes
+// scratch - 256 entries of working storage
+// report - receives the analysis
+// return - 1 when a sideband spacing was found, 0 otherwise
+////////////////////////////////////////////////////////////////////////////
+uint8_t analyzeSidebands(const int16_t *spectrum, int16_t *scratch, SidebandReport &report) {
+  int32_t sum = 0;
+  int32_t logSum = 0;
+  for (uint16_t k = 0; k < FFT_BINS; k++) {
+    scratch[k] = log2Q8(spectrum[k]);
+    sum += spectrum[k];
+    logSum += scratch[k];
+  }
+  int16_t mean = (int16_t)(logSum / FFT_BINS);
+  for (uint16_t k = 0; k < FFT_BINS; k++) // Hann window, 1 - cos(2 * pi * (k + 1/2) / 256) for unit mean gain
+    scratch[k] = (int16_t)(((int32_t)(scratch[k] - mean) * (16384 - cosQ14(2 * k + 1))) >> 14);
+
+  // The sample below the search is real, so a falling edge is not taken for a peak
+  SpectrumPeak candidates[CEPSTRUM_CANDIDATES];
+  SpectrumPeakPicker picker;
+  picker.begin(candidates, CEPSTRUM_CANDIDATES, PEAK_INTERP_PARABOLIC);
+  for (uint16_t q = 0; q < FFT_BINS; q++)
+    picker.push(q + 1 < CEPSTRUM_MIN_QUEFRENCY ? 0 : cepstrumMagnitude(scratch, q));
+  uint8_t count = picker.finish();
+  int8_t fundamental = -1;
+  int32_t minimum = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (candidates[i].position < ((uint16_t)CEPSTRUM_MIN_QUEFRENCY << 8))
+      continue;
+    if (fundamental < 0) // Largest first, so this sets the minimum
+      minimum = (int32_t)candidates[i].magnitude * CEPSTRUM_PEAK_FRACTION;
+    else if (((int32_t)candidates[i].magnitude << 8) < minimum || candidates[i].position > candidates[fundamental].position)
+      continue;
+    fundamental = i;
+  }
+  report.spacing = 0;
+  if (fundamental >= 0)
+    report.quefrency = candidates[fundamental];
+  if (fundamental < 0 || report.quefrency.magnitude < CEPSTRUM_MIN_PEAK) {
+    report.quefrency.position = 0;
+    report.quefrency.magnitude = 0;
+  }
+  else {
+    // A line spacing of D bins repeats 512 / D times over the mirrored record
+    uint32_t spacing = (512UL << 16) / report.quefrency.position;
+    report.spacing = spacing > 0xFFFF ? 0xFFFF : (uint16_t)spacing;
+  }
+
+  // Twice the mean bin, saturated so a loud record cannot wrap negative
+  int32_t level = (sum / FFT_BINS) * 2;
+  int16_t threshold = level > 32767 ? 32767 : (int16_t)level;
+  report.carrierCount = findPeaks(spectrum, FFT_BINS, report.carriers, SIDEBAND_CARRIERS, PEAK_INTERP_PARABOLIC);
+  for (uint8_t i = 0; i < SIDEBAND_CARRIERS; i++) {
+    report.sidebands[i] = 0;
+    if (i < report.carrierCount && report.spacing != 0)
+      report.sidebands[i] = countSidebands(spectrum, FFT_BINS, report.carriers[i].position, report.spacing, threshold, SIDEBAND_MAX_ORDER);
+  }
+  return report.spacing != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Analyzes a batch of records stored back to back. Records share no state
+// besides scratch, so a host can split a batch across threads by giving
+// each thread its own slice and scratch buffer.
+////////////////////////////////////////////////////////////////////////////
+// spectra - count * 256 FFT magnitudes
+// count - number of records
+// scratch - 256 entries of working storage
+// reports - receives count reports
+// return - number of records with a sideband spacing
+////////////////////////////////////////////////////////////////////////////
+uint16_t analyzeSidebandBatch(const int16_t *spectra, uint16_t count, int16_t *scratch, SidebandReport *reports) {
+  uint16_t found = 0;
+  for (uint16_t i = 0; i < count; i++)
+    found += analyzeSidebands(spectra + (uint32_t)i * FFT_BINS, scratch, reports[i]);
+  return found;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Integer square root (bit by bit, no multiplies).
+////////////////////////////////////////////////////////////////////////////
+// value - input
+// return - floor(sqrt(value))
+////////////////////////////////////////////////////////////////////////////
+uint16_t isqrt32(uint32_t value) {
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > value)
+    bit >>= 2;
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+  return (uint16_t)root;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Cross-axis analyzer constructor. Call begin() before pushing bins.
+////////////////////////////////////////////////////////////////////////////
+CrossAxisAnalyzer::CrossAxisAnalyzer() {
+  begin(0, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Starts a new record.
+////////////////////////////////////////////////////////////////////////////
+// ratio - 256 entries for X/Y per bin in Q8.8, or 0
+// magnitude - 256 entries for the vector magnitude per bin, or 0
+////////////////////////////////////////////////////////////////////////////
+void CrossAxisAnalyzer::begin(uint16_t *ratio, uint16_t *magnitude) {
+  _ratio = ratio;
+  _magnitude = magnitude;
+  _xEnergy = 0;
+  _yEnergy = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Processes one bin of both axes. Negative magnitudes are treated as 0.
+// The ratio saturates at 0xFFFF when Y is 0, and is 1.0 when both are 0.
+////////////////////////////////////////////////////////////////////////////
+// bin - bin index
+// xData, yData - raw FFT magnitudes of the bin
+////////////////////////////////////////////////////////////////////////////
+void CrossAxisAnalyzer::push(uint8_t bin, int16_t xData, int16_t yData) {
+  uint32_t x = xData > 0 ? xData : 0;
+  uint32_t y = yData > 0 ? yData : 0;
+  uint32_t xx = x * x;
+  uint32_t yy = y * y;
+  _xEnergy += xx >> 8;
+  _yEnergy += yy >> 8;
+  if (_magnitude)
+    _magnitude[bin] = isqrt32(xx + yy);
+  if (_ratio) {
+    uint32_t ratio = 256;
+    if (y != 0)
+      ratio = (x << 8) / y;
+    else if (x != 0)
+      ratio = 0xFFFF;
+    _ratio[bin] = ratio > 0xFFFF ? 0xFFFF : (uint16_t)ratio;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the directionality index of the record in Q15, 0 when the
+// record is empty.
+////////////////////////////////////////////////////////////////////////////
+int16_t CrossAxisAnalyzer::directionality() const {
+  uint32_t x = _xEnergy;
+  uint32_t y = _yEnergy;
+  while ((x + y) >= 0x10000UL) {
+    x >>= 1;
+    y >>= 1;
+  }
+  if (x + y == 0)
+    return 0;
+  return (int16_t)((((int32_t)x - (int32_t)y) * 32767) / (int32_t)(x + y));
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Builds the cumulative energy of a spectrum, so the energy of any band
+// costs two lookups. Units match CrossAxisAnalyzer energies, which keeps
+// a full record of 32767 LSB bins inside 32 bits.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins
+// prefix - receives bins entries
+////////////////////////////////////////////////////////////////////////////
+void energyPrefix(const int16_t *spectrum, uint16_t bins, uint32_t *prefix) {
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < bins; i++) {
+    sum += ((uint32_t)((int32_t)spectrum[i] * spectrum[i])) >> 8;
+    prefix[i] = sum;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Returns the energy of a band from a prefix built by energyPrefix.
+////////////////////////////////////////////////////////////////////////////
+// prefix - cumulative energy
+// firstBin, lastBin - band edges in bins, inclusive
+// return - sum of squared bins / 256
+////////////////////////////////////////////////////////////////////////////
+uint32_t bandEnergy(const uint32_t *prefix, uint16_t firstBin, uint16_t lastBin) {
+  if (lastBin < firstBin)
+    return 0;
+  return prefix[lastBin] - (firstBin ? prefix[firstBin - 1] : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Downsamples a spectrum keeping the largest bin of each group, so peaks
+// survive at every pyramid level.
+////////////////////////////////////////////////////////////////////////////
+// spectrum - FFT magnitudes
+// bins - number of bins, a multiple of factor
+// factor - bins per output
+// out - receives bins / factor values
+////////////////////////////////////////////////////////////////////////////
+void maxPool(const int16_t *spectrum, uint16_t bins, uint8_t factor, int16_t *out) {
+  for (uint16_t i = 0; i + factor <= bins; i += factor) {
+    int16_t peak = spectrum[i];
+    for (uint8_t j = 1; j < factor; j++) {
+      if (spectrum[i + j] > peak)
+        peak = spectrum[i + j];
+    }
+    out[i / factor] = peak;
+  }
+}
@@ -0,0 +1,202 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Spectrum.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Spectrum analysis helpers for the 256-bin ADIS16229 FFT records read through the ADIS16000
+//  gateway. Everything here works on caller-provided storage and never allocates, so it can run
+//  on the Arduino between SPI reads as well as on a host processing exported records.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_SPECTRUM_H
+#define ADIS16000_SPECTRUM_H
+
+#include "Arduino.h"
+
+// Number of FFT bins per axis in an ADIS16229 record
+#define FFT_BINS 		256
+
+// Sub-bin interpolation modes for the peak picker
+#define PEAK_INTERP_NONE		0
+#define PEAK_INTERP_PARABOLIC	1
+#define PEAK_INTERP_GAUSSIAN	2
+
+// Lookup tables live in flash on AVR
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef pgm_read_word
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#endif
+
+// Lowest quefrency searched by the sideband detector. Lower quefrencies
+// describe the spectral envelope and the analysis window rather than
+// sideband families.
+#define CEPSTRUM_MIN_QUEFRENCY	8
+
+// Smallest cepstrum peak accepted as a sideband family (log2 units in Q10)
+#define CEPSTRUM_MIN_PEAK		128
+
+// Quefrency peaks weighed per record, and the fraction of the largest (Q8)
+// that the lowest of them must reach to be taken as the fundamental. A
+// spacing of D bins has D / 2 rahmonics below 256, and families wide enough
+// to count SIDEBAND_MAX_ORDER lines each side have D up to 32.
+#define CEPSTRUM_CANDIDATES		16
+#define CEPSTRUM_PEAK_FRACTION	160
+
+// Carriers examined and sideband orders counted per record
+#define SIDEBAND_CARRIERS	3
+#define SIDEBAND_MAX_ORDER	4
+
+// Spectrum pyramid levels (max-pooled by 4 at each level)
+#define PYRAMID_L1_BINS		64
+#define PYRAMID_L2_BINS		16
+
+// Called once per bin while an FFT record is read out (see ADIS16000::readFFTStream)
+typedef void (*FFTBinHandler)(uint8_t bin, int16_t xData, int16_t yData, void *context);
+
+// Single spectral peak. Position is in bins with 8 fractional bits (Q8.8).
+struct SpectrumPeak {
+	uint16_t position;
+	int16_t magnitude;
+};
+
+// Streaming top-K local maxima picker. Bins are pushed in order; a fixed size
+// min-heap keeps the K largest peaks so no sorting of the full record is needed.
+class SpectrumPeakPicker {
+
+public:
+	SpectrumPeakPicker();
+
+	// Starts a new record. Peaks are stored in the caller's array of k entries.
+	void begin(SpectrumPeak *peaks, uint8_t k, uint8_t interp);
+
+	// Pushes the next bin of the record.
+	void push(int16_t sensorData);
+
+	// Sorts the peaks by descending magnitude. Returns the number of peaks found.
+	uint8_t finish();
+
+	// Number of peaks currently held.
+	uint8_t count() const { return _count; }
+
+private:
+	void insert(int16_t left, int16_t center, int16_t right, uint8_t bin);
+	void siftDown(uint8_t i, uint8_t n);
+
+	SpectrumPeak *_peaks;
+	uint8_t _k;
+	uint8_t _count;
+	uint8_t _interp;
+	uint16_t _bin;
+	int16_t _prev1;
+	int16_t _prev2;
+
+};
+
+// Shaft running speed estimate and its first three harmonic amplitudes.
+// Position is the 1x frequency in bins (Q8.8); ratios are 2x/1x and 3x/1x (Q8.8).
+struct RunningSpeed {
+	uint16_t position;
+	int16_t amplitude[3];
+	uint16_t ratio2x;
+	uint16_t ratio3x;
+};
+
+// Sideband analysis of one record. The quefrency peak position is in cepstrum
+// samples (Q8.8) and spacing is the matching sideband spacing in bins (Q8.8).
+// sidebands[i] counts the lines found on both sides of carriers[i].
+struct SidebandReport {
+	SpectrumPeak quefrency;
+	uint16_t spacing;
+	SpectrumPeak carriers[SIDEBAND_CARRIERS];
+	uint8_t carrierCount;
+	uint8_t sidebands[SIDEBAND_CARRIERS];
+};
+
+// Fused X/Y analysis of an FFT record. Per-bin outputs are optional and go
+// to caller arrays of 256 entries; record energies drive the directionality index.
+class CrossAxisAnalyzer {
+
+public:
+	CrossAxisAnalyzer();
+
+	// Starts a new record. ratio receives X/Y per bin (Q8.8), magnitude receives sqrt(X^2 + Y^2). Either may be 0.
+	void begin(uint16_t *ratio, uint16_t *magnitude);
+
+	// Processes one bin of both axes.
+	void push(uint8_t bin, int16_t xData, int16_t yData);
+
+	// Directionality index (Ex - Ey) / (Ex + Ey) in Q15. +32767 is purely X, -32767 purely Y.
+	int16_t directionality() const;
+
+	// Record energies (sum of squared bins / 256)
+	uint32_t xEnergy() const { return _xEnergy; }
+	uint32_t yEnergy() const { return _yEnergy; }
+
+private:
+	uint16_t *_ratio;
+	uint16_t *_magnitude;
+	uint32_t _xEnergy;
+	uint32_t _yEnergy;
+
+};
+
+// Integer square root. Returns floor(sqrt(value)).
+uint16_t isqrt32(uint32_t value);
+
+// Downsampled X/Y spectra: 256 -> 64 -> 16 bins
+struct SpectrumPyramid {
+	int16_t level1[2][PYRAMID_L1_BINS];
+	int16_t level2[2][PYRAMID_L2_BINS];
+};
+
+// Finds the k largest peaks in a complete spectrum. Returns the number of peaks found.
+uint8_t findPeaks(const int16_t *spectrum, uint16_t bins, SpectrumPeak *peaks, uint8_t k, uint8_t interp);
+
+// Converts a peak position to frequency. Returns frequency in Hz.
+float peakFrequency(const SpectrumPeak &peak, float binWidth);
+
+// Comb search for the running speed between minBin and maxBin. Returns 1 when found, 0 otherwise.
+uint8_t estimateRunningSpeed(const int16_t *spectrum, uint16_t bins, uint16_t minBin, uint16_t maxBin, RunningSpeed &result);
+
+// Same search restricted to candidates derived from already picked peaks. Returns 1 when found, 0 otherwise.
+uint8_t estimateRunningSpeed(const int16_t *spectrum, uint16_t bins, const SpectrumPeak *peaks, uint8_t count,
+	uint16_t minBin, uint16_t maxBin, RunningSpeed &result);
+
+// Converts a running speed estimate to shaft speed. Returns speed in RPM.
+float runningSpeedRPM(const RunningSpeed &speed, float binWidth);
+
+// Cumulative band energy of a spectrum. prefix[i] is the sum of squared bins 0..i, divided by 256.
+void energyPrefix(const int16_t *spectrum, uint16_t bins, uint32_t *prefix);
+
+// Energy of bins firstBin..lastBin (inclusive) from a prefix. Returns sum of squared bins / 256.
+uint32_t bandEnergy(const uint32_t *prefix, uint16_t firstBin, uint16_t lastBin);
+
+// Max-pools bins values by factor into bins / factor outputs.
+void maxPool(const int16_t *spectrum, uint16_t bins, uint8_t factor, int16_t *out);
+
+// Real cepstrum of a 256-bin spectrum. Output is in log2 units with 10 fractional bits.
+void cepstrum(const int16_t *spectrum, int16_t *logScratch, int16_t *out);
+
+// Counts sideband lines at carrier +/- n * spacing above threshold. Returns the number found.
+uint8_t countSidebands(const int16_t *spectrum, uint16_t bins, uint16_t carrier, uint16_t spacing, int16_t threshold, uint8_t maxOrder);
+
+// Cepstrum and sideband analysis of one 256-bin spectrum. Returns 1 when a sideband spacing was found, 0 otherwise.
+uint8_t analyzeSidebands(const int16_t *spectrum, int16_t *scratch, SidebandReport &report);
+
+// Analyzes count consecutive 256-bin spectra. Returns the number of records with a sideband spacing.
+uint16_t analyzeSidebandBatch(const int16_t *spectra, uint16_t count, int16_t *scratch, SidebandReport *reports);
+
+#endif
@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Stream.cpp
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Framed serial streaming for binary records. Frames are COBS encoded with a CRC16 trailer and a
+//  zero delimiter. The gateway side encodes into a TX ring that drains to Serial between SPI reads;
+//  the host side decodes incrementally into a fixed buffer.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "ADIS16000Stream.h"
+
+////////////////////////////////////////////////////////////////////////////
+// Updates a CRC16-CCITT with one byte.
+////////////////////////////////////////////////////////////////////////////
+// crc - running CRC, start with 0xFFFF
+// data - next byte
+// return - updated CRC
+////////////////////////////////////////////////////////////////////////////
+uint16_t crc16Update(uint16_t crc, uint8_t data) {
+  crc ^= (uint16_t)data << 8;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Frame writer constructor.
+////////////////////////////////////////////////////////////////////////////
+// ring - TX ring storage, at least FRAME_RING_MIN bytes
+// size - ring size in bytes
+// out - output port, normally Serial
+// blockingOut - out does not implement availableForWrite (the Print
+// default returns 0, as on SoftwareSerial and most network clients)
+////////////////////////////////////////////////////////////////////////////
+FrameWriter::FrameWriter(uint8_t *ring, uint16_t size, Print &out, bool blockingOut) {
+  _ring = ring;
+  _size = size;
+  _out = &out;
+  _blockingOut = blockingOut;
+  _head = 0;
+  _tail = 0;
+  _ready = 0;
+  _codePos = 0;
+  _code = 0;
+  _crc = 0xFFFF;
+}
+
+uint16_t FrameWriter::pending() const {
+  return (_head + _size - _tail) % _size;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Queues one raw byte, draining the ring first when it is full.
+////////////////////////////////////////////////////////////////////////////
+void FrameWriter::push(uint8_t data) {
+  while (space() == 0)
+    pump();
+  _ring[_head] = data;
+  _head = (_head + 1) % _size;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Patches the code byte of the open COBS block, which makes the block
+// final and available to pump(), and opens the next block.
+////////////////////////////////////////////////////////////////////////////
+void FrameWriter::closeBlock() {
+  _ring[_codePos] = _code;
+  _ready = _head;
+  _codePos = _head;
+  push(0); // Placeholder for the next code byte
+  _code = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// COBS encodes one payload byte into the open block.
+////////////////////////////////////////////////////////////////////////////
+void FrameWriter::encode(uint8_t data) {
+  if (data == 0) {
+    closeBlock();
+    return;
+  }
+  push(data);
+  if (++_code == 0xFF)
+    closeBlock();
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Starts a new frame by opening its first COBS block.
+////////////////////////////////////////////////////////////////////////////
+void FrameWriter::begin() {
+  _crc = 0xFFFF;
+  _codePos = _head;
+  push(0);
+  _code = 1;
+}
+
+void FrameWriter::write(uint8_t data) {
+  _crc = crc16Update(_crc, data);
+  encode(data);
+}
+
+void FrameWriter::write(const uint8_t *data, uint16_t length) {
+  while (length--)
+    write(*data++);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Finishes the frame: CRC (little-endian), last code byte, delimiter.
+////////////////////////////////////////////////////////////////////////////
+void FrameWriter::end() {
+  uint16_t crc = _crc;
+  encode((uint8_t)crc);
+  encode((uint8_t)(crc >> 8));
+  _ring[_codePos] = _code;
+  push(0x00);
+  _ready = _head;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Moves finished bytes to the output without blocking. Call this between
+// SPI reads so a frame drains while the next record is acquired. Nothing
+// is sent while the port reports a full TX buffer. Outputs constructed
+// with blockingOut get one byte per call instead, which may block for
+// that byte, so the ring still drains.
+////////////////////////////////////////////////////////////////////////////
+// return - number of bytes sent
+////////////////////////////////////////////////////////////////////////////
+uint16_t FrameWriter::pump() {
+  uint16_t sent = 0;
+  int room = _blockingOut ? 1 : _out->availableForWrite();
+  while (room-- > 0 && _tail != _ready) {
+    _out->write(_ring[_tail]);
+    _tail = (_tail + 1) % _size;
+    sent++;
+  }
+  return sent;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Frame parser constructor.
+////////////////////////////////////////////////////////////////////////////
+// buffer - decoded frame storage, largest payload plus two CRC bytes
+// size - buffer size in bytes
+////////////////////////////////////////////////////////////////////////////
+FrameParser::FrameParser(uint8_t *buffer, uint16_t size) {
+  _buffer = buffer;
+  _size = size;
+  _length = 0;
+  _remaining = 0;
+  _code = 0xFF;
+  _overflow = false;
+  _crcErrors = 0;
+  _overflows = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Decodes one received byte. A zero byte ends the frame, which is then
+// checked against its CRC trailer. Bad frames are counted and dropped.
+////////////////////////////////////////////////////////////////////////////
+// data - received byte
+// return - payload length of a completed valid frame, 0 otherwise
+////////////////////////////////////////////////////////////////////////////
+uint16_t FrameParser::push(uint8_t data) {
+  if (data == 0) {
+    uint16_t length = _length;
+    bool overflow = _overflow;
+    _length = 0;
+    _remaining = 0;
+    _code = 0xFF;
+    _overflow = false;
+    if (overflow) {
+      _overflows++;
+      return 0;
+    }
+    if (length < 3)
+      return 0; // Empty or truncated frame
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length - 2; i++)
+      crc = crc16Update(crc, _buffer[i]);
+    if (crc != ((uint16_t)_buffer[length - 2] | ((uint16_t)_buffer[length - 1] << 8))) {
+      _crcErrors++;
+      return 0;
+    }
+    return length - 2;
+  }
+
+  if (_remaining == 0) {
+    // Code byte. Every block but a full one implies a zero before the next.
+    if (_code != 0xFF && !_overflow) {
+      if (_length < _size)
+        _buffer[_length++] = 0;
+      else
+        _overflow = true;
+    }
+    _code = data;
+    _remaining = data - 1;
+    return 0;
+  }
+
+  if (_length < _size)
+    _buffer[_length++] = data;
+  else
+    _overflow = true;
+  _remaining--;
+  return 0;
+}
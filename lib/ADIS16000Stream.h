@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  ADIS16000Stream.h
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 
+//  Framed serial streaming for binary records. Frames are COBS encoded with a CRC16 trailer and a
+//  zero delimiter. The gateway side encodes into a TX ring that drains to Serial between SPI reads;
+//  the host side decodes incrementally into a fixed buffer.
+//
+//  This example is free software. You can redistribute it and/or modify it
+//  under the terms of the GNU Lesser Public License as published by the Free Software
+//  Foundation, either version 3 of the License, or any later version.
+//
+//  This example is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS 
+//  FOR A PARTICULAR PURPOSE.  See the GNU Lesser Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser Public License along with 
+//  this example.  If not, see <http://www.gnu.org/licenses/>.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ADIS16000_STREAM_H
+#define ADIS16000_STREAM_H
+
+#include "Arduino.h"
+
+// Smallest TX ring that can hold a pending COBS block plus its code byte
+#define FRAME_RING_MIN		256
+
+// CRC16-CCITT (polynomial 0x1021, initial value 0xFFFF). Returns the updated CRC.
+uint16_t crc16Update(uint16_t crc, uint8_t data);
+
+// Gateway side frame encoder. Encoded bytes are queued in a caller-provided
+// ring of at least FRAME_RING_MIN bytes and drained to out by pump(). Outputs
+// that do not implement availableForWrite need blockingOut, or a full ring
+// waits forever.
+class FrameWriter {
+
+public:
+	FrameWriter(uint8_t *ring, uint16_t size, Print &out, bool blockingOut = false);
+
+	// Starts a new frame.
+	void begin();
+
+	// Adds payload bytes to the current frame. Blocks (pumping out) only when the ring is full.
+	void write(uint8_t data);
+	void write(const uint8_t *data, uint16_t length);
+
+	// Appends the CRC and delimiter, making the whole frame available to pump().
+	void end();
+
+	// Sends as many finished bytes as out accepts without blocking (one per call with blockingOut). Returns the number sent.
+	uint16_t pump();
+
+	// Bytes queued in the ring, finished or not.
+	uint16_t pending() const;
+
+	// Free bytes in the ring.
+	uint16_t space() const { return _size - 1 - pending(); }
+
+private:
+	void push(uint8_t data);
+	void encode(uint8_t data);
+	void closeBlock();
+
+	uint8_t *_ring;
+	uint16_t _size;
+	Print *_out;
+	bool _blockingOut;
+	uint16_t _head;
+	uint16_t _tail;
+	uint16_t _ready;
+	uint16_t _codePos;
+	uint8_t _code;
+	uint16_t _crc;
+
+};
+
+// Host side incremental frame decoder. Decodes into a caller buffer with no per-frame allocation.
+class FrameParser {
+
+public:
+	FrameParser(uint8_t *buffer, uint16_t size);
+
+	// Feeds one received byte. Returns the payload length when a valid frame completes, 0 otherwise.
+	uint16_t push(uint8_t data);
+
+	// Payload of the last completed frame.
+	const uint8_t *data() const { return _buffer; }
+
+	// Frames dropped for bad CRC or overflow.
+	uint32_t crcErrors() const { return _crcErrors; }
+	uint32_t overflows() const { return _overflows; }
+
+private:
+	uint8_t *_buffer;
+	uint16_t _size;
+	uint16_t _length;
+	uint8_t _remaining;
+	uint8_t _code;
+	bool _overflow;
+	uint32_t _crcErrors;
+	uint32_t _overflows;
+
+};
+
+#endif